@@ -36,3 +36,67 @@ atomic_ptr_cas (void **ptr, void *old, void *new)
         : "cc");
     return retval;
 }
+
+int
+atomic_int_get (int *ptr)
+{
+    return *ptr;
+}
+
+void
+atomic_int_set (int *ptr, int val)
+{
+    *ptr = val;
+}
+
+//  Add val to *ptr and return the previous value
+
+int
+atomic_int_add (int *ptr, int val)
+{
+    __asm__ volatile (
+        "lock xadd %0, %1"
+        : "+r" (val), "+m" (*ptr)
+        :
+        : "cc");
+    return val;
+}
+
+int
+atomic_int_swap (int *ptr, int val)
+{
+    __asm__ volatile (
+        "lock xchg %0, %1"
+        : "+r" (val), "+m" (*ptr));
+    return val;
+}
+
+int
+atomic_int_cas (int *ptr, int old, int new)
+{
+    int retval;
+    __asm__ volatile (
+        "lock cmpxchg %2, %1"
+        : "=a" (retval), "+m" (*ptr)
+        : "r" (new), "0" (old)
+        : "cc");
+    return retval;
+}
+
+unsigned int
+atomic_uint_get (unsigned int *ptr)
+{
+    return *ptr;
+}
+
+void
+atomic_uint_set (unsigned int *ptr, unsigned int val)
+{
+    *ptr = val;
+}
+
+void
+atomic_pause ()
+{
+    __asm__ volatile ("pause");
+}
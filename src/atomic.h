@@ -19,4 +19,29 @@ void *
 void *
     atomic_ptr_cas (void **ptr, void *old, void *new);
 
+int
+    atomic_int_get (int *ptr);
+
+void
+    atomic_int_set (int *ptr, int val);
+
+int
+    atomic_int_add (int *ptr, int val);
+
+int
+    atomic_int_swap (int *ptr, int val);
+
+int
+    atomic_int_cas (int *ptr, int old, int new);
+
+unsigned int
+    atomic_uint_get (unsigned int *ptr);
+
+void
+    atomic_uint_set (unsigned int *ptr, unsigned int val);
+
+//  Hint to the CPU that we are in a spin loop
+void
+    atomic_pause ();
+
 #endif
@@ -4,21 +4,130 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
 
-#define _POSIX_C_SOURCE 199309L
+#define _GNU_SOURCE
 
 #include <assert.h>
 #include <time.h>
 #include <stdio.h>
+#include <pthread.h>
 
+#include "atomic.h"
 #include "clock.h"
 
-//  Return current time in ms
+//  When the CPU advertises an invariant TSC, time is read from the
+//  TSC and converted to ns with a 32.32 fixed point factor measured
+//  against CLOCK_MONOTONIC by clock_calibrate. Otherwise, and before
+//  calibration, every call goes to clock_gettime.
 
-uint64_t
-clock_now ()
+#if (defined (__x86_64__) || defined (__i386__)) && defined (__SIZEOF_INT128__)
+#   define CLOCK_HAVE_TSC
+#   include <cpuid.h>
+#endif
+
+static pthread_once_t s_calibrate_once = PTHREAD_ONCE_INIT;
+
+static uint64_t
+s_monotonic_ns ()
 {
     struct timespec tv;
     const int rc = clock_gettime (CLOCK_MONOTONIC, &tv);
     assert (rc == 0);
-    return (uint64_t) tv.tv_sec * 1000 + tv.tv_nsec / 1000000;
+    return (uint64_t) tv.tv_sec * 1000000000 + tv.tv_nsec;
+}
+
+#if defined (CLOCK_HAVE_TSC)
+
+//  Set once the factors below are in place
+static int s_use_tsc;
+static uint64_t s_base_tsc;
+static uint64_t s_base_ns;
+static uint64_t s_tsc_mult;
+
+static uint64_t
+s_rdtsc ()
+{
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return (uint64_t) hi << 32 | lo;
+}
+
+//  Sample TSC and monotonic clock at (nearly) the same instant
+
+static void
+s_sample (uint64_t *tsc, uint64_t *ns)
+{
+    const uint64_t before = s_rdtsc ();
+    *ns = s_monotonic_ns ();
+    const uint64_t after = s_rdtsc ();
+    *tsc = before + (after - before) / 2;
+}
+
+static void
+s_calibrate ()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid (0x80000007, &eax, &ebx, &ecx, &edx) == 0)
+        return;
+    if ((edx & (1 << 8)) == 0)
+        return;
+
+    uint64_t tsc0, ns0, tsc1, ns1;
+    s_sample (&tsc0, &ns0);
+    do
+        s_sample (&tsc1, &ns1);
+    while (ns1 - ns0 < 10000000);
+    if (tsc1 <= tsc0)
+        return;
+
+    s_tsc_mult = (uint64_t)
+        (((unsigned __int128) (ns1 - ns0) << 32) / (tsc1 - tsc0));
+    s_base_tsc = tsc1;
+    s_base_ns = ns1;
+    atomic_int_set (&s_use_tsc, 1);
+}
+
+#else
+
+static void
+s_calibrate ()
+{
+}
+
+#endif
+
+void
+clock_calibrate ()
+{
+    pthread_once (&s_calibrate_once, s_calibrate);
+}
+
+//  Return current time in ms
+
+uint64_t
+clock_now ()
+{
+    return clock_now_ns () / 1000000;
+}
+
+//  Return current time in us
+
+uint64_t
+clock_now_us ()
+{
+    return clock_now_ns () / 1000;
+}
+
+//  Return current time in ns
+
+uint64_t
+clock_now_ns ()
+{
+#if defined (CLOCK_HAVE_TSC)
+    if (atomic_int_get (&s_use_tsc)) {
+        const uint64_t ticks = s_rdtsc () - s_base_tsc;
+        return s_base_ns
+            + (uint64_t) (((unsigned __int128) ticks * s_tsc_mult) >> 32);
+    }
+#endif
+    return s_monotonic_ns ();
 }
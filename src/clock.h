@@ -9,7 +9,23 @@
 
 #include <stdint.h>
 
+//  Monotonic time. All three functions use the same time base, which
+//  is the TSC once clock_calibrate has found an invariant one, and
+//  clock_gettime otherwise.
+
+//  Measure the TSC against CLOCK_MONOTONIC, taking about 10ms on x86
+//  CPUs with an invariant TSC. Only the first call does any work;
+//  reactor_new makes it.
+void
+    clock_calibrate ();
+
 uint64_t
     clock_now ();
 
+uint64_t
+    clock_now_us ();
+
+uint64_t
+    clock_now_ns ();
+
 #endif
@@ -8,11 +8,9 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <pthread.h>
-#include <unistd.h>
-#include <sys/eventfd.h>
 
-#include "atomic.h"
 #include "msg.h"
+#include "mailbox.h"
 #include "dispatcher.h"
 #include "zkernel.h"
 
@@ -20,8 +18,7 @@ struct proxy;
 void proxy_message (struct proxy *proxy, msg_t *msg);
 
 struct dispatcher {
-    int ctrl_fd;
-    void *mbox;
+    mailbox_t *mbox;
     pthread_t thread_handle;
 };
 
@@ -33,8 +30,8 @@ dispatcher_new ()
 {
     dispatcher_t *self = (dispatcher_t *) malloc (sizeof *self);
     if (self) {
-        *self = (dispatcher_t) { .ctrl_fd = eventfd (0, 0) };
-        if (self->ctrl_fd == -1) {
+        *self = (dispatcher_t) { .mbox = mailbox_new () };
+        if (self->mbox == NULL) {
             free (self);
             self = NULL;
         }
@@ -42,7 +39,7 @@ dispatcher_new ()
             const int rc =
                 pthread_create (&self->thread_handle, NULL, s_loop, self);
             if (rc) {
-                close (self->ctrl_fd);
+                mailbox_destroy (&self->mbox);
                 free (self);
                 self = NULL;
             }
@@ -62,7 +59,7 @@ dispatcher_destroy (dispatcher_t **self_p)
         assert (cmd);
         dispatcher_send (self, (msg_t *) cmd);
         pthread_join (self->thread_handle, NULL);
-        close (self->ctrl_fd);
+        mailbox_destroy (&self->mbox);
         free (self);
         *self_p = NULL;
     }
@@ -71,20 +68,7 @@ dispatcher_destroy (dispatcher_t **self_p)
 void
 dispatcher_send (dispatcher_t *self, msg_t *msg)
 {
-    void *tail = atomic_ptr_get (&self->mbox);
-    atomic_ptr_set ((void **) &msg->next, tail);
-    void *prev = atomic_ptr_cas (&self->mbox, tail, msg);
-    while (prev != tail) {
-        tail = prev;
-        atomic_ptr_set ((void **) &msg->next, tail);
-        prev = atomic_ptr_cas (&self->mbox, tail, msg);
-    }
-    //  Wake up I/O thread if necessary
-    if (prev == NULL) {
-        const uint64_t v = 1;
-        const int rc = write (self->ctrl_fd, &v, sizeof v);
-        assert (rc == sizeof v);
-    }
+    mailbox_push (self->mbox, msg);
 }
 
 static void *
@@ -96,37 +80,16 @@ s_loop (void *udata)
     bool stop = false;
 
     while (!stop) {
-        uint64_t x;
-        const int rc = read (self->ctrl_fd, &x, sizeof x);
-        assert (rc == sizeof x);
-
-        struct msg_t *msg =
-            (struct msg_t *) atomic_ptr_swap (&self->mbox, NULL);
-        assert (msg);
-
-        //  Transform LIFO to FIFO
-        msg_t *prev = NULL;
-        while (msg->next) {
-            msg_t *next = msg->next;
-            msg->next = prev;
-            prev = msg;
-            msg = next;
-        }
-        msg->next = prev;
-
-        while (msg) {
-            struct msg_t *next_msg = msg->next;
-            if (msg->msg_type == ZKERNEL_KILL) {
-                stop = true;
-                msg_destroy (&msg);
-            }
-            else
-            if (msg->proxy)
-                proxy_message (msg->proxy, msg);
-            else
-                msg_destroy (&msg);
-            msg = next_msg;
+        struct msg_t *msg = mailbox_wait (self->mbox);
+        if (msg->msg_type == ZKERNEL_KILL) {
+            stop = true;
+            msg_destroy (&msg);
         }
+        else
+        if (msg->proxy)
+            proxy_message (msg->proxy, msg);
+        else
+            msg_destroy (&msg);
     }
 
     return NULL;
@@ -0,0 +1,173 @@
+//  Epoll poller class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "epoll_poller.h"
+#include "zkernel.h"
+
+#define MAX_EVENTS 64
+
+struct epoll_poller {
+    poller_t base;
+    int epoll_fd;
+    //  Kernel lacks epoll_pwait2, timeouts are rounded up to ms
+    bool ms_timeouts;
+    struct epoll_event events [MAX_EVENTS];
+};
+
+static struct poller_ops ops;
+
+epoll_poller_t *
+epoll_poller_new ()
+{
+    epoll_poller_t *self = (epoll_poller_t *) malloc (sizeof *self);
+    if (self) {
+        *self = (epoll_poller_t) {
+            .base.ops = ops,
+            .epoll_fd = epoll_create (1),
+        };
+        if (self->epoll_fd == -1) {
+            free (self);
+            self = NULL;
+        }
+    }
+
+    return self;
+}
+
+poller_t *
+epoll_poller_new_poller ()
+{
+    return (poller_t *) epoll_poller_new ();
+}
+
+static void
+s_destroy (poller_t **base_p)
+{
+    assert (base_p);
+    if (*base_p) {
+        epoll_poller_t *self = (epoll_poller_t *) *base_p;
+        close (self->epoll_fd);
+        free (self);
+        *base_p = NULL;
+    }
+}
+
+static void
+s_add (poller_t *base, poller_registration_t *reg, int fd, void *udata)
+{
+    assert (reg);
+    *reg = (poller_registration_t) { .fd = fd, .udata = udata };
+}
+
+static int
+s_arm (poller_t *base, poller_registration_t *reg, int event_mask)
+{
+    epoll_poller_t *self = (epoll_poller_t *) base;
+    assert (self);
+    assert (reg);
+    assert (reg->fd != -1);
+
+    struct epoll_event ev = { .data.ptr = reg };
+    if ((event_mask & ZKERNEL_POLLIN) == ZKERNEL_POLLIN)
+        ev.events |= EPOLLIN;
+    if ((event_mask & ZKERNEL_POLLOUT) == ZKERNEL_POLLOUT)
+        ev.events |= EPOLLOUT;
+    if ((event_mask & POLLER_EDGE_TRIGGERED) != 0)
+        ev.events |= EPOLLET;
+    else
+    if ((event_mask & POLLER_PERSISTENT) == 0)
+        ev.events |= EPOLLONESHOT;
+
+    const int rc = epoll_ctl (
+        self->epoll_fd, reg->added? EPOLL_CTL_MOD: EPOLL_CTL_ADD,
+        reg->fd, &ev);
+    if (rc == 0)
+        reg->added = true;
+    return rc;
+}
+
+static void
+s_remove (poller_t *base, poller_registration_t *reg)
+{
+    epoll_poller_t *self = (epoll_poller_t *) base;
+    assert (self);
+    assert (reg);
+
+    if (reg->added) {
+        struct epoll_event ev = {};
+        const int rc = epoll_ctl (
+            self->epoll_fd, EPOLL_CTL_DEL, reg->fd, &ev);
+        assert (rc == 0 || errno == EBADF || errno == ENOENT);
+    }
+    *reg = (poller_registration_t) { .fd = -1 };
+}
+
+static int
+s_wait (poller_t *base, poller_event_t *events, int max_events, int64_t timeout)
+{
+    epoll_poller_t *self = (epoll_poller_t *) base;
+    assert (self);
+
+    if (max_events > MAX_EVENTS)
+        max_events = MAX_EVENTS;
+
+    int nfds = -1;
+    if (!self->ms_timeouts) {
+        const struct timespec ts = {
+            .tv_sec = timeout / 1000000000,
+            .tv_nsec = timeout % 1000000000,
+        };
+        nfds = epoll_pwait2 (
+            self->epoll_fd, self->events, max_events,
+            timeout >= 0? &ts: NULL, NULL);
+        if (nfds == -1 && errno == ENOSYS)
+            self->ms_timeouts = true;
+    }
+    if (self->ms_timeouts) {
+        int ms = -1;
+        //  Clamp first; rounding up a huge timeout would overflow
+        if (timeout >= (int64_t) INT_MAX * 1000000)
+            ms = INT_MAX;
+        else
+        if (timeout >= 0)
+            ms = (int) ((timeout + 999999) / 1000000);
+        nfds = epoll_wait (self->epoll_fd, self->events, max_events, ms);
+    }
+    for (int i = 0; i < nfds; i++) {
+        const uint32_t what = self->events [i].events;
+        poller_registration_t *reg =
+            (poller_registration_t *) self->events [i].data.ptr;
+        uint32_t flags = 0;
+        if ((what & EPOLLIN) == EPOLLIN)
+            flags |= ZKERNEL_INPUT_READY;
+        if ((what & EPOLLOUT) == EPOLLOUT)
+            flags |= ZKERNEL_OUTPUT_READY;
+        if ((what & (EPOLLERR | EPOLLHUP)) != 0)
+            flags |= ZKERNEL_IO_ERROR;
+        events [i] = (poller_event_t) { .udata = reg->udata, .flags = flags };
+    }
+
+    return nfds;
+}
+
+static struct poller_ops ops = {
+    .add = s_add,
+    .arm = s_arm,
+    .remove = s_remove,
+    .wait = s_wait,
+    .destroy = s_destroy,
+};
@@ -0,0 +1,20 @@
+//  Epoll poller class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#ifndef __EPOLL_POLLER_H_INCLUDED__
+#define __EPOLL_POLLER_H_INCLUDED__
+
+#include "poller.h"
+
+typedef struct epoll_poller epoll_poller_t;
+
+epoll_poller_t *
+    epoll_poller_new ();
+
+poller_t *
+    epoll_poller_new_poller ();
+
+#endif
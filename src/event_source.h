@@ -0,0 +1,38 @@
+//  Event source class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#ifndef __EVENT_SOURCE_H_INCLUDED__
+#define __EVENT_SOURCE_H_INCLUDED__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "poller.h"
+#include "timer_wheel.h"
+#include "zkernel.h"
+
+struct io_object;
+
+//  Reactor state for one I/O object. It is embedded in the I/O object,
+//  so starting I/O does not allocate; only the reactor touches it.
+struct event_source {
+    //  Registered with the poller unless -1
+    int fd;
+    poller_registration_t registration;
+    struct timer timer;
+    uint32_t event_mask;
+    //  Readiness not yet consumed, edge-triggered mode only
+    uint32_t ready;
+    //  Link in the list of sources with readiness they are
+    //  interested in, edge-triggered mode only
+    bool pending;
+    struct event_source *prev_pending;
+    struct event_source *next_pending;
+    struct io_object *io_object;
+    io_descriptor_t *io_descriptor;
+};
+
+#endif
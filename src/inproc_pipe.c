@@ -0,0 +1,133 @@
+//  In-process pipe class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "atomic.h"
+#include "pdu.h"
+#include "socket.h"
+#include "socket_options.h"
+#include "inproc_pipe.h"
+
+//  Flow control for one direction. Free-running counters; their
+//  difference is the number of PDUs in flight. Each side writes only
+//  its own counter, so the pipe needs no lock.
+struct inproc_flow {
+    socket_t *to;
+    uint32_t hwm;
+    //  Owned by the sender
+    unsigned int sent;
+    //  Sender's last reading of received; re-read only at the HWM,
+    //  which keeps the sender off the receiver's cache line
+    unsigned int received_seen;
+    //  Written by the receiver, on a cache line of its own. The pipe
+    //  comes from malloc, so the padding is a full line on each side.
+    uint8_t pad1 [64];
+    unsigned int received;
+    uint8_t pad2 [64];
+};
+
+struct inproc_pipe {
+    socket_t *a;
+    socket_t *b;
+    //  a to b, then b to a
+    struct inproc_flow flow [2];
+};
+
+static int
+    s_reserve (struct inproc_flow *flow, uint32_t count);
+
+inproc_pipe_t *
+inproc_pipe_new (socket_t *a, socket_t *b)
+{
+    assert (a);
+    assert (b);
+    assert (a != b);
+
+    inproc_pipe_t *self = (inproc_pipe_t *) malloc (sizeof *self);
+    if (self)
+        *self = (inproc_pipe_t) {
+            .a = a,
+            .b = b,
+            .flow = {
+                {
+                    .to = b,
+                    .hwm = socket_options_sndhwm (socket_get_options (a))
+                },
+                {
+                    .to = a,
+                    .hwm = socket_options_sndhwm (socket_get_options (b))
+                }
+            }
+        };
+    return self;
+}
+
+void
+inproc_pipe_destroy (inproc_pipe_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        inproc_pipe_t *self = *self_p;
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+int
+inproc_pipe_send (inproc_pipe_t *self, socket_t *from, pdu_t *pdu)
+{
+    assert (self);
+    assert (pdu);
+
+    return inproc_pipe_send_batch (self, from, pdu, pdu, 1);
+}
+
+int
+inproc_pipe_send_batch (
+    inproc_pipe_t *self, socket_t *from,
+    pdu_t *head, pdu_t *tail, uint32_t count)
+{
+    assert (self);
+    assert (from == self->a || from == self->b);
+    assert (head);
+    assert (tail);
+
+    struct inproc_flow *flow = &self->flow [from == self->a? 0: 1];
+    if (s_reserve (flow, count) == -1)
+        return -1;
+    for (pdu_t *pdu = head; pdu != tail; pdu = (pdu_t *) pdu->base.next)
+        pdu->pipe = self;
+    tail->pipe = self;
+    socket_send_batch (flow->to, &head->base, &tail->base);
+    return 0;
+}
+
+void
+inproc_pipe_consumed (inproc_pipe_t *self, socket_t *to)
+{
+    assert (self);
+    assert (to == self->a || to == self->b);
+
+    struct inproc_flow *flow = &self->flow [to == self->b? 0: 1];
+    atomic_uint_set (&flow->received, flow->received + 1);
+}
+
+static int
+s_reserve (struct inproc_flow *flow, uint32_t count)
+{
+    if (flow->hwm > 0 && flow->sent - flow->received_seen + count > flow->hwm) {
+        flow->received_seen = atomic_uint_get (&flow->received);
+        if (flow->sent - flow->received_seen + count > flow->hwm) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+    flow->sent += count;
+    return 0;
+}
@@ -0,0 +1,44 @@
+//  In-process pipe class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#ifndef __INPROC_PIPE_H_INCLUDED__
+#define __INPROC_PIPE_H_INCLUDED__
+
+#include <stdint.h>
+
+#include "pdu.h"
+#include "socket.h"
+
+//  Joins two sockets in the same process. PDUs are pushed by pointer
+//  into the peer's mailbox, with no session, protocol engine or
+//  reactor in between. Each direction is bounded by the sending
+//  socket's sndhwm option.
+typedef struct inproc_pipe inproc_pipe_t;
+
+inproc_pipe_t *
+    inproc_pipe_new (socket_t *a, socket_t *b);
+
+//  PDUs in flight refer to the pipe; destroy it after both sockets
+void
+    inproc_pipe_destroy (inproc_pipe_t **self_p);
+
+//  Pass PDU to the socket at the other end. Returns -1 with errno set
+//  to EAGAIN when the HWM is reached; the caller keeps the PDU then.
+int
+    inproc_pipe_send (inproc_pipe_t *self, socket_t *from, pdu_t *pdu);
+
+//  Pass count PDUs head .. tail, linked through base.next, with one
+//  mailbox operation. Sends all of them or none.
+int
+    inproc_pipe_send_batch (
+        inproc_pipe_t *self, socket_t *from,
+        pdu_t *head, pdu_t *tail, uint32_t count);
+
+//  Receiving socket took a PDU off the pipe
+void
+    inproc_pipe_consumed (inproc_pipe_t *self, socket_t *to);
+
+#endif
@@ -11,9 +11,15 @@
 
 #include "msg.h"
 #include "zkernel.h"
+#include "iobuf_pool.h"
+#include "event_source.h"
 
 typedef struct io_object io_object_t;
 
+struct reactor;
+
+//  Timer intervals are in us; 0 leaves the timer unarmed.
+
 struct io_object_ops {
     int (*init) (io_object_t *self, io_descriptor_t *io_descriptor, int *fd, uint32_t *timer_interval);
     void (*destroy) (io_object_t **self_p);
@@ -25,6 +31,11 @@ struct io_object_ops {
 struct io_object {
     void *io_handle;
     struct io_object_ops ops;
+    //  Reactor state, set up when I/O starts
+    struct event_source event_source;
+    //  Reactor running the object and its buffer pool, set before init
+    struct reactor *reactor;
+    iobuf_pool_t *iobuf_pool;
 };
 
 void
@@ -0,0 +1,583 @@
+//  io_uring poller class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "atomic.h"
+#include "io_uring_poller.h"
+#include "zkernel.h"
+
+//  Readiness is tracked with oneshot IORING_OP_POLL_ADD requests.
+//  Arming, re-arming and cancelling only queue submission entries;
+//  they are handed to the kernel together with the next wait, so a
+//  loop iteration costs a single io_uring_enter no matter how many
+//  descriptors were re-armed.
+
+#define RING_ENTRIES 256
+#define ZOMBIE_SLOTS 64
+
+struct io_uring_poller {
+    poller_t base;
+    int ring_fd;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_array;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    struct io_uring_cqe *cqes;
+    unsigned int cq_mask;
+    //  Entries queued but not yet submitted
+    unsigned int to_submit;
+    //  Completions moved out of the ring to make room, see s_stash.
+    //  They are older than any completion still in the ring.
+    struct io_uring_cqe *stash;
+    size_t stash_head;
+    size_t stash_count;
+    size_t stash_capacity;
+    //  Registrations removed while their request was in flight. The
+    //  kernel hands their addresses back once more; completions for
+    //  them are dropped without looking at the memory, which may be
+    //  in use again. Kept in an open addressing hash table, where
+    //  NULL marks a free slot; an address may be in it more than once.
+    void **zombies;
+    size_t zombie_count;
+    size_t zombie_mask;
+};
+
+static void
+    s_destroy_rings (io_uring_poller_t *self);
+
+static void
+    s_submit (io_uring_poller_t *self);
+
+static void
+    s_stash (io_uring_poller_t *self);
+
+static int
+    s_reap (io_uring_poller_t *self, poller_event_t *events, int max_events);
+
+static void
+    s_zombie_add (io_uring_poller_t *self, void *addr);
+
+static bool
+    s_zombie_reaped (io_uring_poller_t *self, void *user_data);
+
+static struct poller_ops ops;
+
+static int
+s_io_uring_setup (unsigned int entries, struct io_uring_params *params)
+{
+    return (int) syscall (__NR_io_uring_setup, entries, params);
+}
+
+static int
+s_io_uring_enter (int fd, unsigned int to_submit, unsigned int min_complete,
+    unsigned int flags, void *arg, size_t arg_size)
+{
+    return (int) syscall (__NR_io_uring_enter,
+        fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+io_uring_poller_t *
+io_uring_poller_new ()
+{
+    io_uring_poller_t *self =
+        (io_uring_poller_t *) malloc (sizeof *self);
+    if (!self)
+        return NULL;
+    *self = (io_uring_poller_t) {
+        .base.ops = ops,
+        .ring_fd = -1,
+        .sq_ring = MAP_FAILED,
+        .cq_ring = MAP_FAILED,
+        .sqes = MAP_FAILED,
+    };
+
+    struct io_uring_params params = {
+        .flags = IORING_SETUP_CQSIZE,
+        .cq_entries = RING_ENTRIES * 16,
+    };
+    self->ring_fd = s_io_uring_setup (RING_ENTRIES, &params);
+    if (self->ring_fd == -1)
+        goto fail;
+    if ((params.features & IORING_FEAT_EXT_ARG) == 0)
+        goto fail;
+
+    self->sq_ring_size =
+        params.sq_off.array + params.sq_entries * sizeof (unsigned int);
+    self->cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+        if (self->cq_ring_size > self->sq_ring_size)
+            self->sq_ring_size = self->cq_ring_size;
+        self->cq_ring_size = self->sq_ring_size;
+    }
+
+    self->sq_ring = mmap (
+        NULL, self->sq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, self->ring_fd, IORING_OFF_SQ_RING);
+    if (self->sq_ring == MAP_FAILED)
+        goto fail;
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0) {
+        self->cq_ring = mmap (
+            NULL, self->cq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, self->ring_fd, IORING_OFF_CQ_RING);
+        if (self->cq_ring == MAP_FAILED)
+            goto fail;
+    }
+    self->sqes_size = params.sq_entries * sizeof (struct io_uring_sqe);
+    self->sqes = (struct io_uring_sqe *) mmap (
+        NULL, self->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, self->ring_fd, IORING_OFF_SQES);
+    if (self->sqes == MAP_FAILED)
+        goto fail;
+
+    char *sq = (char *) self->sq_ring;
+    char *cq = self->cq_ring != MAP_FAILED? (char *) self->cq_ring: sq;
+    self->sq_head = (unsigned int *) (sq + params.sq_off.head);
+    self->sq_tail = (unsigned int *) (sq + params.sq_off.tail);
+    self->sq_array = (unsigned int *) (sq + params.sq_off.array);
+    self->sq_mask = *(unsigned int *) (sq + params.sq_off.ring_mask);
+    self->sq_entries = params.sq_entries;
+    self->cq_head = (unsigned int *) (cq + params.cq_off.head);
+    self->cq_tail = (unsigned int *) (cq + params.cq_off.tail);
+    self->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    self->cq_mask = *(unsigned int *) (cq + params.cq_off.ring_mask);
+
+    self->stash_capacity = params.cq_entries;
+    self->stash = (struct io_uring_cqe *)
+        malloc (self->stash_capacity * sizeof *self->stash);
+    if (!self->stash)
+        goto fail;
+    self->zombies = (void **) calloc (ZOMBIE_SLOTS, sizeof *self->zombies);
+    if (!self->zombies)
+        goto fail;
+    self->zombie_mask = ZOMBIE_SLOTS - 1;
+
+    return self;
+
+fail:
+    s_destroy_rings (self);
+    free (self->stash);
+    free (self->zombies);
+    free (self);
+    return NULL;
+}
+
+poller_t *
+io_uring_poller_new_poller ()
+{
+    return (poller_t *) io_uring_poller_new ();
+}
+
+static void
+s_destroy_rings (io_uring_poller_t *self)
+{
+    if (self->sqes != MAP_FAILED)
+        munmap (self->sqes, self->sqes_size);
+    if (self->cq_ring != MAP_FAILED)
+        munmap (self->cq_ring, self->cq_ring_size);
+    if (self->sq_ring != MAP_FAILED)
+        munmap (self->sq_ring, self->sq_ring_size);
+    if (self->ring_fd != -1)
+        close (self->ring_fd);
+}
+
+static void
+s_destroy (poller_t **base_p)
+{
+    assert (base_p);
+    if (*base_p) {
+        io_uring_poller_t *self = (io_uring_poller_t *) *base_p;
+        //  Collect registrations still referenced by the kernel
+        s_submit (self);
+        while (self->zombie_count > 0) {
+            poller_event_t events [16];
+            const int rc = s_io_uring_enter (
+                self->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+            assert (rc != -1 || errno == EINTR
+                || errno == EBUSY || errno == EAGAIN);
+            s_reap (self, events, 16);
+        }
+        s_destroy_rings (self);
+        free (self->stash);
+        free (self->zombies);
+        free (self);
+        *base_p = NULL;
+    }
+}
+
+//  Hand queued entries over to the kernel
+
+static void
+s_submit (io_uring_poller_t *self)
+{
+    while (self->to_submit > 0) {
+        const int rc = s_io_uring_enter (
+            self->ring_fd, self->to_submit, 0, 0, NULL, 0);
+        if (rc == -1) {
+            //  Completion queue backed up or kernel short of memory;
+            //  make room for completions and try again
+            if (errno == EBUSY || errno == EAGAIN)
+                s_stash (self);
+            else
+                assert (errno == EINTR);
+            continue;
+        }
+        self->to_submit -= rc;
+    }
+}
+
+//  Move completions from the ring to the stash, so the kernel can
+//  post the ones it holds back. They are reaped later, in order.
+
+static void
+s_stash (io_uring_poller_t *self)
+{
+    if (self->stash_head > 0) {
+        memmove (
+            self->stash, &self->stash [self->stash_head],
+            (self->stash_count - self->stash_head) * sizeof *self->stash);
+        self->stash_count -= self->stash_head;
+        self->stash_head = 0;
+    }
+
+    unsigned int head = *self->cq_head;
+    const unsigned int tail = atomic_uint_get (self->cq_tail);
+    while (head != tail) {
+        if (self->stash_count == self->stash_capacity) {
+            //  Out of memory; what is left stays in the ring
+            const size_t capacity = 2 * self->stash_capacity;
+            struct io_uring_cqe *stash = (struct io_uring_cqe *)
+                realloc (self->stash, capacity * sizeof *stash);
+            if (!stash)
+                break;
+            self->stash = stash;
+            self->stash_capacity = capacity;
+        }
+        const struct io_uring_cqe *cqe = &self->cqes [head & self->cq_mask];
+        head++;
+        //  Nothing to report for cancellations and zombies
+        void *user_data = (void *) (uintptr_t) cqe->user_data;
+        if (user_data == NULL || s_zombie_reaped (self, user_data))
+            continue;
+        self->stash [self->stash_count++] = *cqe;
+    }
+    atomic_uint_set (self->cq_head, head);
+}
+
+static void
+s_queue (io_uring_poller_t *self,
+    int opcode, int fd, uint32_t poll_events, void *addr, void *user_data)
+{
+    unsigned int tail = *self->sq_tail;
+    if (tail - atomic_uint_get (self->sq_head) == self->sq_entries)
+        s_submit (self);
+
+    const unsigned int index = tail & self->sq_mask;
+    struct io_uring_sqe *sqe = &self->sqes [index];
+    memset (sqe, 0, sizeof *sqe);
+    sqe->opcode = (uint8_t) opcode;
+    sqe->fd = fd;
+    sqe->poll32_events = poll_events;
+    sqe->addr = (uint64_t) (uintptr_t) addr;
+    sqe->user_data = (uint64_t) (uintptr_t) user_data;
+    self->sq_array [index] = index;
+    atomic_uint_set (self->sq_tail, tail + 1);
+    self->to_submit++;
+}
+
+static void
+s_poll_add (io_uring_poller_t *self, poller_registration_t *reg)
+{
+    const int poll_mask =
+        reg->event_mask & (ZKERNEL_POLLIN | ZKERNEL_POLLOUT);
+    assert (poll_mask != 0);
+
+    uint32_t poll_events = 0;
+    if ((poll_mask & ZKERNEL_POLLIN) == ZKERNEL_POLLIN)
+        poll_events |= POLLIN;
+    if ((poll_mask & ZKERNEL_POLLOUT) == ZKERNEL_POLLOUT)
+        poll_events |= POLLOUT;
+    s_queue (self, IORING_OP_POLL_ADD, reg->fd, poll_events, NULL, reg);
+    reg->poll_mask = poll_mask;
+    reg->active = true;
+}
+
+//  Cancel request in flight. Its completion, with -ECANCELED or
+//  with the events that raced the cancellation, tells us when the
+//  registration is no longer referenced by the kernel.
+
+static void
+s_poll_remove (io_uring_poller_t *self, poller_registration_t *reg)
+{
+    s_queue (self, IORING_OP_POLL_REMOVE, -1, 0, reg, NULL);
+    reg->cancelling = true;
+}
+
+static void
+s_add (poller_t *base, poller_registration_t *reg, int fd, void *udata)
+{
+    assert (reg);
+    *reg = (poller_registration_t) { .fd = fd, .udata = udata };
+}
+
+static int
+s_arm (poller_t *base, poller_registration_t *reg, int event_mask)
+{
+    io_uring_poller_t *self = (io_uring_poller_t *) base;
+    assert (self);
+    assert (reg);
+    assert (reg->fd != -1);
+    assert ((event_mask & POLLER_EDGE_TRIGGERED) == 0);
+
+    reg->event_mask = event_mask;
+    const int poll_mask = event_mask & (ZKERNEL_POLLIN | ZKERNEL_POLLOUT);
+    if (reg->active) {
+        //  Re-armed with the new mask once cancellation completes
+        if (poll_mask != reg->poll_mask && !reg->cancelling)
+            s_poll_remove (self, reg);
+    }
+    else
+    if (poll_mask != 0)
+        s_poll_add (self, reg);
+
+    return 0;
+}
+
+//  The cancellation is submitted after the request it cancels, and
+//  a later request for the same address after both, so the first
+//  completion carrying the address of a zombie is the zombie's own.
+
+static void
+s_remove (poller_t *base, poller_registration_t *reg)
+{
+    io_uring_poller_t *self = (io_uring_poller_t *) base;
+    assert (self);
+    assert (reg);
+
+    if (reg->active) {
+        if (!reg->cancelling)
+            s_poll_remove (self, reg);
+        s_zombie_add (self, reg);
+    }
+    *reg = (poller_registration_t) { .fd = -1 };
+}
+
+static size_t
+s_zombie_slot (io_uring_poller_t *self, void *addr)
+{
+    const uint64_t hash =
+        (uint64_t) (uintptr_t) addr * 0x9e3779b97f4a7c15ull;
+    return (size_t) (hash >> 32) & self->zombie_mask;
+}
+
+//  Rehash into a table twice the size; false when out of memory
+
+static bool
+s_zombie_grow (io_uring_poller_t *self)
+{
+    const size_t slots = 2 * (self->zombie_mask + 1);
+    void **zombies = (void **) calloc (slots, sizeof *zombies);
+    if (!zombies)
+        return false;
+    void **old_zombies = self->zombies;
+    const size_t old_slots = self->zombie_mask + 1;
+    self->zombies = zombies;
+    self->zombie_mask = slots - 1;
+    for (size_t i = 0; i < old_slots; i++)
+        if (old_zombies [i]) {
+            size_t slot = s_zombie_slot (self, old_zombies [i]);
+            while (self->zombies [slot])
+                slot = (slot + 1) & self->zombie_mask;
+            self->zombies [slot] = old_zombies [i];
+        }
+    free (old_zombies);
+    return true;
+}
+
+//  The table is grown once half full. Out of memory, it fills up,
+//  always keeping a free slot to end probes; with none to spare we
+//  wait for the kernel to hand zombies back.
+
+static void
+s_zombie_add (io_uring_poller_t *self, void *addr)
+{
+    if (2 * (self->zombie_count + 1) > self->zombie_mask + 1)
+        s_zombie_grow (self);
+    while (self->zombie_count + 1 > self->zombie_mask) {
+        s_submit (self);
+        const int rc = s_io_uring_enter (
+            self->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        assert (rc != -1 || errno == EINTR
+            || errno == EBUSY || errno == EAGAIN);
+        s_stash (self);
+    }
+
+    size_t slot = s_zombie_slot (self, addr);
+    while (self->zombies [slot])
+        slot = (slot + 1) & self->zombie_mask;
+    self->zombies [slot] = addr;
+    self->zombie_count++;
+}
+
+//  Drop the zombie entry matching a completion, if there is one
+
+static bool
+s_zombie_reaped (io_uring_poller_t *self, void *user_data)
+{
+    if (self->zombie_count == 0)
+        return false;
+
+    size_t hole = s_zombie_slot (self, user_data);
+    while (self->zombies [hole] != user_data) {
+        if (self->zombies [hole] == NULL)
+            return false;
+        hole = (hole + 1) & self->zombie_mask;
+    }
+    //  Move later entries back into the hole, unless that would put
+    //  them before the slot they hash to
+    size_t slot = hole;
+    while (true) {
+        slot = (slot + 1) & self->zombie_mask;
+        void *addr = self->zombies [slot];
+        if (addr == NULL)
+            break;
+        const size_t home = s_zombie_slot (self, addr);
+        if (((slot - home) & self->zombie_mask)
+                >= ((slot - hole) & self->zombie_mask)) {
+            self->zombies [hole] = addr;
+            hole = slot;
+        }
+    }
+    self->zombies [hole] = NULL;
+    self->zombie_count--;
+    return true;
+}
+
+//  Completions are handed over one at a time: re-arming a registration
+//  may submit, and submitting may stash what is left in the ring.
+
+static int
+s_reap (io_uring_poller_t *self, poller_event_t *events, int max_events)
+{
+    int n = 0;
+
+    while (n < max_events) {
+        struct io_uring_cqe cqe;
+        if (self->stash_head < self->stash_count)
+            cqe = self->stash [self->stash_head++];
+        else {
+            const unsigned int head = *self->cq_head;
+            if (head == atomic_uint_get (self->cq_tail))
+                break;
+            cqe = self->cqes [head & self->cq_mask];
+            atomic_uint_set (self->cq_head, head + 1);
+        }
+        poller_registration_t *reg =
+            (poller_registration_t *) (uintptr_t) cqe.user_data;
+        //  Completion of a cancellation request
+        if (reg == NULL)
+            continue;
+        if (s_zombie_reaped (self, reg))
+            continue;
+
+        reg->active = false;
+        reg->cancelling = false;
+        if (cqe.res == -ECANCELED) {
+            if ((reg->event_mask & (ZKERNEL_POLLIN | ZKERNEL_POLLOUT)) != 0)
+                s_poll_add (self, reg);
+            continue;
+        }
+
+        uint32_t flags = 0;
+        if (cqe.res < 0)
+            flags |= ZKERNEL_IO_ERROR;
+        else {
+            if ((cqe.res & POLLIN) == POLLIN)
+                flags |= ZKERNEL_INPUT_READY;
+            if ((cqe.res & POLLOUT) == POLLOUT)
+                flags |= ZKERNEL_OUTPUT_READY;
+            if ((cqe.res & (POLLERR | POLLHUP)) != 0)
+                flags |= ZKERNEL_IO_ERROR;
+        }
+        if ((reg->event_mask & POLLER_PERSISTENT) != 0)
+            s_poll_add (self, reg);
+        else
+            reg->event_mask = 0;
+        events [n++] = (poller_event_t) { .udata = reg->udata, .flags = flags };
+    }
+
+    if (self->stash_head == self->stash_count)
+        self->stash_head = self->stash_count = 0;
+    return n;
+}
+
+static int
+s_wait (poller_t *base, poller_event_t *events, int max_events, int64_t timeout)
+{
+    io_uring_poller_t *self = (io_uring_poller_t *) base;
+    assert (self);
+
+    const int n = s_reap (self, events, max_events);
+    if (n > 0)
+        return n;
+    if (timeout == 0) {
+        s_submit (self);
+        return s_reap (self, events, max_events);
+    }
+
+    //  Submit pending requests and wait in one go
+    struct __kernel_timespec ts = {
+        .tv_sec = timeout / 1000000000,
+        .tv_nsec = timeout % 1000000000,
+    };
+    struct io_uring_getevents_arg arg = {
+        .ts = timeout > 0? (uint64_t) (uintptr_t) &ts: 0,
+    };
+    const int rc = s_io_uring_enter (
+        self->ring_fd, self->to_submit, 1,
+        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof arg);
+    if (rc == -1) {
+        if (errno == EINTR)
+            return -1;
+        //  Nothing was submitted when the completion queue is backed
+        //  up or the kernel is short of memory. Reaping makes room;
+        //  the next wait submits again.
+        assert (errno == ETIME || errno == EBUSY || errno == EAGAIN);
+    }
+    else
+        self->to_submit -= rc;
+
+    return s_reap (self, events, max_events);
+}
+
+static struct poller_ops ops = {
+    .add = s_add,
+    .arm = s_arm,
+    .remove = s_remove,
+    .wait = s_wait,
+    .destroy = s_destroy,
+};
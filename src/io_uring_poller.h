@@ -0,0 +1,22 @@
+//  io_uring poller class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#ifndef __IO_URING_POLLER_H_INCLUDED__
+#define __IO_URING_POLLER_H_INCLUDED__
+
+#include "poller.h"
+
+typedef struct io_uring_poller io_uring_poller_t;
+
+//  Returns NULL when the kernel lacks io_uring or IORING_FEAT_EXT_ARG,
+//  or when out of memory
+io_uring_poller_t *
+    io_uring_poller_new ();
+
+poller_t *
+    io_uring_poller_new_poller ();
+
+#endif
@@ -4,11 +4,15 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
 
+#define _GNU_SOURCE
+
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "iobuf.h"
 
@@ -29,13 +33,66 @@ iobuf_new (size_t size)
     return self;
 }
 
+iobuf_t *
+iobuf_new_ring (size_t size)
+{
+    const size_t page_size = (size_t) sysconf (_SC_PAGESIZE);
+    size = (size + page_size - 1) / page_size * page_size;
+
+    iobuf_t *self = (iobuf_t *) malloc (sizeof *self);
+    if (!self)
+        return NULL;
+    const int fd = memfd_create ("iobuf", MFD_CLOEXEC);
+    if (fd == -1)
+        goto fail;
+    if (ftruncate (fd, size) == -1)
+        goto fail;
+    //  Reserve address space for both views, then map the file over
+    //  each half
+    uint8_t *base = (uint8_t *) mmap (
+        NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        goto fail;
+    for (int i = 0; i < 2; i++) {
+        void *ptr = mmap (
+            base + i * size, size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_FIXED, fd, 0);
+        if (ptr == MAP_FAILED) {
+            munmap (base, 2 * size);
+            goto fail;
+        }
+    }
+    close (fd);
+
+    *self = (iobuf_t) {
+        .base = base, .size = size, .r = base, .w = base, .ring = true };
+    return self;
+
+fail:
+    if (fd != -1)
+        close (fd);
+    free (self);
+    return NULL;
+}
+
+void
+iobuf_init (iobuf_t *self, uint8_t *data, size_t size)
+{
+    assert (self);
+    *self = (iobuf_t) {
+        .base = data, .size = size, .r = data, .w = data };
+}
+
 void
 iobuf_destroy (iobuf_t **self_p)
 {
     assert (self_p);
     if (*self_p) {
         iobuf_t *self = *self_p;
-        free (self->base);
+        if (self->ring)
+            munmap (self->base, 2 * self->size);
+        else
+            free (self->base);
         free (self);
         *self_p = NULL;
     }
@@ -55,7 +112,7 @@ iobuf_send (iobuf_t *self, int fd)
 {
     const ssize_t rc = send (fd, self->r, iobuf_available (self), 0);
     if (rc > 0)
-        self->r += rc;
+        iobuf_drop (self, (size_t) rc);
     return rc;
 }
 
@@ -12,11 +12,15 @@
 #include <string.h>
 #include <sys/types.h>
 
+//  A ring buffer maps its pages twice in a row, so the data and the
+//  free space are always contiguous, even when they wrap around. Both
+//  pointers are moved back by size once r leaves the first mapping.
 struct iobuf {
     uint8_t *base;
     size_t size;
     uint8_t *r;
     uint8_t *w;
+    bool ring;
 };
 
 typedef struct iobuf iobuf_t;
@@ -24,9 +28,19 @@ typedef struct iobuf iobuf_t;
 iobuf_t *
     iobuf_new (size_t size);
 
+//  Create ring buffer; size is rounded up to a multiple of the page
+//  size. Returns NULL if the mirrored mapping cannot be set up.
+iobuf_t *
+    iobuf_new_ring (size_t size);
+
 void
     iobuf_destroy (iobuf_t **self_p);
 
+//  Set up buffer over storage owned by the caller, typically inside
+//  the object using it. Such a buffer is not passed to iobuf_destroy.
+void
+    iobuf_init (iobuf_t *self, uint8_t *data, size_t size);
+
 inline void
 iobuf_reset (iobuf_t *self)
 {
@@ -42,7 +56,23 @@ iobuf_available (iobuf_t *self)
 inline size_t
 iobuf_space (iobuf_t *self)
 {
-    return (size_t) (self->base + self->size - self->w);
+    const uint8_t *start = self->ring? self->r: self->base;
+    return (size_t) (start + self->size - self->w);
+}
+
+//  Advance read pointer. A drained buffer starts over at base, so a
+//  linear one gets all of its space back.
+inline void
+iobuf_drop (iobuf_t *self, size_t length)
+{
+    self->r += length;
+    if (self->r == self->w)
+        self->r = self->w = self->base;
+    else
+    if (self->r >= self->base + self->size) {
+        self->r -= self->size;
+        self->w -= self->size;
+    }
 }
 
 ssize_t
@@ -58,7 +88,7 @@ iobuf_read (iobuf_t *self, void *ptr, size_t n)
     if (n > available)
         n = available;
     memcpy (ptr, self->r, n);
-    self->r += n;
+    iobuf_drop (self, n);
     return n;
 }
 
@@ -90,12 +120,6 @@ iobuf_put (iobuf_t *self, size_t length)
     self->w += length;
 }
 
-inline void
-iobuf_drop (iobuf_t *self, size_t length)
-{
-    self->r += length;
-}
-
 inline size_t
 iobuf_copy (iobuf_t *dst, iobuf_t *src, size_t n)
 {
@@ -0,0 +1,165 @@
+//  I/O buffer pool class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "iobuf.h"
+#include "iobuf_pool.h"
+
+//  Smallest size class is 4 KiB, the largest 128 MiB
+#define MIN_SHIFT       12
+#define CLASSES         16
+//  Idle buffers kept per size class
+#define DEPTH           64
+
+struct bucket {
+    size_t count;
+    iobuf_t *buffers [DEPTH];
+};
+
+struct iobuf_pool {
+    size_t max_cached;
+    iobuf_pool_stats_t stats;
+    struct bucket buckets [CLASSES];
+};
+
+static int
+    s_class_index (size_t size);
+
+static iobuf_t *
+    s_iobuf_new (size_t size);
+
+static void
+    s_stats_add (uint64_t *counter, uint64_t value);
+
+iobuf_pool_t *
+iobuf_pool_new (size_t max_cached)
+{
+    iobuf_pool_t *self = (iobuf_pool_t *) malloc (sizeof *self);
+    if (self)
+        *self = (iobuf_pool_t) { .max_cached = max_cached };
+    return self;
+}
+
+void
+iobuf_pool_destroy (iobuf_pool_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        iobuf_pool_t *self = *self_p;
+        for (int i = 0; i < CLASSES; i++) {
+            struct bucket *bucket = &self->buckets [i];
+            while (bucket->count > 0)
+                iobuf_destroy (&bucket->buffers [--bucket->count]);
+        }
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+iobuf_t *
+iobuf_pool_get (iobuf_pool_t *self, size_t size)
+{
+    assert (self);
+
+    //  Round up to the size class, so the buffer can be reused
+    //  for any request of that class
+    if (size < (size_t) 1 << MIN_SHIFT)
+        size = (size_t) 1 << MIN_SHIFT;
+    else
+    if ((size & (size - 1)) != 0)
+        size = (size_t) 1 << (64 - __builtin_clzll (size));
+
+    iobuf_t *iobuf = NULL;
+    const int index = s_class_index (size);
+    if (index < CLASSES && self->buckets [index].count > 0) {
+        struct bucket *bucket = &self->buckets [index];
+        iobuf = bucket->buffers [--bucket->count];
+        s_stats_add (&self->stats.buffers_cached, -1);
+        s_stats_add (&self->stats.bytes_cached, -iobuf->size);
+        iobuf_reset (iobuf);
+    }
+    else
+        iobuf = s_iobuf_new (size);
+
+    if (iobuf) {
+        s_stats_add (&self->stats.buffers_in_use, 1);
+        s_stats_add (&self->stats.bytes_in_use, iobuf->size);
+    }
+    return iobuf;
+}
+
+void
+iobuf_pool_put (iobuf_pool_t *self, iobuf_t **iobuf_p)
+{
+    assert (self);
+    assert (iobuf_p);
+    iobuf_t *iobuf = *iobuf_p;
+    if (iobuf == NULL)
+        return;
+    *iobuf_p = NULL;
+
+    s_stats_add (&self->stats.buffers_in_use, -1);
+    s_stats_add (&self->stats.bytes_in_use, -iobuf->size);
+
+    //  Ring buffers may be larger than their class; file them under
+    //  the largest class they can serve
+    const int index = s_class_index (iobuf->size);
+    if (index >= 0 && index < CLASSES
+            && self->buckets [index].count < DEPTH
+            && self->stats.bytes_cached + iobuf->size <= self->max_cached) {
+        struct bucket *bucket = &self->buckets [index];
+        bucket->buffers [bucket->count++] = iobuf;
+        s_stats_add (&self->stats.buffers_cached, 1);
+        s_stats_add (&self->stats.bytes_cached, iobuf->size);
+    }
+    else
+        iobuf_destroy (&iobuf);
+}
+
+void
+iobuf_pool_stats (iobuf_pool_t *self, iobuf_pool_stats_t *stats)
+{
+    assert (self);
+    assert (stats);
+    *stats = (iobuf_pool_stats_t) {
+        .buffers_in_use =
+            __atomic_load_n (&self->stats.buffers_in_use, __ATOMIC_RELAXED),
+        .bytes_in_use =
+            __atomic_load_n (&self->stats.bytes_in_use, __ATOMIC_RELAXED),
+        .buffers_cached =
+            __atomic_load_n (&self->stats.buffers_cached, __ATOMIC_RELAXED),
+        .bytes_cached =
+            __atomic_load_n (&self->stats.bytes_cached, __ATOMIC_RELAXED),
+    };
+}
+
+//  Counters change on the reactor thread only but are read from any
+//  thread, see iobuf_pool_stats. Subtraction wraps, as unsigned
+//  arithmetic does.
+
+static void
+s_stats_add (uint64_t *counter, uint64_t value)
+{
+    __atomic_store_n (counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+static int
+s_class_index (size_t size)
+{
+    return 63 - __builtin_clzll (size) - MIN_SHIFT;
+}
+
+//  Ring buffers let recv fill all free space without compaction;
+//  fall back to a linear buffer if they are not available.
+
+static iobuf_t *
+s_iobuf_new (size_t size)
+{
+    iobuf_t *iobuf = iobuf_new_ring (size);
+    return iobuf? iobuf: iobuf_new (size);
+}
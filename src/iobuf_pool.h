@@ -0,0 +1,50 @@
+//  I/O buffer pool class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#ifndef __IOBUF_POOL_H_INCLUDED__
+#define __IOBUF_POOL_H_INCLUDED__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iobuf.h"
+
+//  Cache of idle I/O buffers, in power of two size classes. Sessions
+//  borrow buffers while data is in flight and hand them back when
+//  they run empty. A pool belongs to one reactor and is used from its
+//  thread only, except iobuf_pool_stats, which any thread may call.
+typedef struct iobuf_pool iobuf_pool_t;
+
+typedef struct iobuf_pool_stats iobuf_pool_stats_t;
+
+struct iobuf_pool_stats {
+    //  Buffers lent out and not yet returned
+    uint64_t buffers_in_use;
+    uint64_t bytes_in_use;
+    //  Idle buffers kept for reuse
+    uint64_t buffers_cached;
+    uint64_t bytes_cached;
+};
+
+//  Keep up to max_cached bytes of idle buffers; 0 disables caching
+iobuf_pool_t *
+    iobuf_pool_new (size_t max_cached);
+
+void
+    iobuf_pool_destroy (iobuf_pool_t **self_p);
+
+//  Return empty buffer holding at least size bytes, or NULL
+iobuf_t *
+    iobuf_pool_get (iobuf_pool_t *self, size_t size);
+
+//  Give buffer obtained from iobuf_pool_get back to the pool
+void
+    iobuf_pool_put (iobuf_pool_t *self, iobuf_t **iobuf_p);
+
+void
+    iobuf_pool_stats (iobuf_pool_t *self, iobuf_pool_stats_t *stats);
+
+#endif
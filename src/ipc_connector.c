@@ -0,0 +1,225 @@
+//  IPC connector class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "socket.h"
+#include "io_object.h"
+#include "ipc_connector.h"
+#include "tcp_session.h"
+#include "shm_session.h"
+#include "msg.h"
+#include "proxy.h"
+#include "reactor_group.h"
+#include "socket_options.h"
+#include "zkernel.h"
+
+//  Retry interval while the listener is missing or its backlog is full
+#define IPC_CONNECTOR_RETRY_INTERVAL 100000
+
+struct ipc_connector {
+    io_object_t base;
+    struct sockaddr_un addr;
+    socklen_t addr_len;
+    int fd;
+    protocol_engine_constructor_t *protocol_engine_constructor;
+    int err;
+    socket_t *owner;
+};
+
+static int
+    io_init (io_object_t *self_, io_descriptor_t *io_descriptor, int *fd, uint32_t *timer_interval);
+
+static int
+    io_event (io_object_t *self_, uint32_t flags, int *fd, uint32_t *timer_interval);
+
+static int
+    io_timeout (io_object_t *self_, int *fd, uint32_t *timer_interval);
+
+static int
+    s_connect (ipc_connector_t *self, int *fd, uint32_t *timer_interval);
+
+static io_object_t *
+    s_new_session (ipc_connector_t *self);
+
+static struct io_object_ops ops = {
+    .init  = io_init,
+    .event = io_event,
+    .timeout = io_timeout
+};
+
+ipc_connector_t *
+ipc_connector_new (protocol_engine_constructor_t *protocol_engine_constructor, socket_t *owner)
+{
+    ipc_connector_t *self = malloc (sizeof *self);
+    if (self)
+        *self = (ipc_connector_t) {
+            .base.ops = ops,
+            .fd = -1,
+            .protocol_engine_constructor = protocol_engine_constructor,
+            .owner = owner
+        };
+    return self;
+}
+
+void
+ipc_connector_destroy (ipc_connector_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        ipc_connector_t *self = *self_p;
+        if (self->fd != -1)
+            close (self->fd);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+int
+ipc_connector_connect (ipc_connector_t *self, const char *path)
+{
+    assert (self);
+    assert (path);
+
+    if (self->addr_len > 0)
+        return -1;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    const size_t path_len = strlen (path);
+    if (path_len == 0 || path_len >= sizeof addr.sun_path) {
+        self->err = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy (addr.sun_path, path, path_len);
+    //  Abstract names are not NUL terminated
+    if (path [0] == '@')
+        addr.sun_path [0] = '\0';
+    self->addr = addr;
+    self->addr_len = (socklen_t)
+        (offsetof (struct sockaddr_un, sun_path)
+            + path_len + (path [0] == '@'? 0: 1));
+    return 0;
+}
+
+int
+ipc_connector_errno (ipc_connector_t *self)
+{
+    assert (self);
+    return self->err;
+}
+
+static int
+io_init (io_object_t *self_, io_descriptor_t *io_descriptor, int *fd, uint32_t *timer_interval)
+{
+    ipc_connector_t *self = (ipc_connector_t *) self_;
+    assert (self);
+    assert (self->addr_len > 0);
+
+    return s_connect (self, fd, timer_interval);
+}
+
+//  Connected socket polled writable; hand it over to a session
+
+static int
+io_event (io_object_t *self_, uint32_t flags, int *fd, uint32_t *timer_interval)
+{
+    ipc_connector_t *self = (ipc_connector_t *) self_;
+    assert (self);
+
+    if ((flags & ZKERNEL_IO_ERROR) == ZKERNEL_IO_ERROR) {
+        close (self->fd);
+        *fd = self->fd = -1;
+        *timer_interval = IPC_CONNECTOR_RETRY_INTERVAL;
+        return 0;
+    }
+
+    io_object_t *session = s_new_session (self);
+    msg_t *msg = NULL;
+    if (session)
+        msg = msg_new (ZKERNEL_SESSION);
+    if (msg == NULL) {
+        io_object_destroy (&session);
+        *fd = self->fd = -1;
+        *timer_interval = IPC_CONNECTOR_RETRY_INTERVAL;
+        return 0;
+    }
+    msg->u.session.session = session;
+    msg->u.session.peer_hash =
+        reactor_group_hash (&self->addr, self->addr_len);
+    proxy_send (socket_proxy (self->owner), msg);
+
+    *fd = self->fd = -1;
+    return 0;
+}
+
+//  Session taking over the connected socket; the socket is closed
+//  on failure
+
+static io_object_t *
+s_new_session (ipc_connector_t *self)
+{
+    const size_t shm_ring_size =
+        socket_options_shm_ring_size (socket_get_options (self->owner));
+    if (shm_ring_size > 0)
+        return (io_object_t *) shm_session_new (
+            self->fd, shm_ring_size, self->owner);
+
+    protocol_engine_t *protocol_engine = self->protocol_engine_constructor ();
+    tcp_session_t *session = NULL;
+    if (protocol_engine)
+        session = tcp_session_new (self->fd, protocol_engine, self->owner);
+    if (session == NULL)
+        close (self->fd);
+    return (io_object_t *) session;
+}
+
+static int
+io_timeout (io_object_t *self_, int *fd, uint32_t *timer_interval)
+{
+    ipc_connector_t *self = (ipc_connector_t *) self_;
+    assert (self);
+
+    return s_connect (self, fd, timer_interval);
+}
+
+//  Connecting a Unix domain socket never blocks: it either completes,
+//  or fails right away. Transient failures arm the retry timer.
+
+static int
+s_connect (ipc_connector_t *self, int *fd, uint32_t *timer_interval)
+{
+    const int s =
+        socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s == -1) {
+        self->err = errno;
+        *timer_interval = IPC_CONNECTOR_RETRY_INTERVAL;
+        return 0;
+    }
+    const int rc =
+        connect (s, (struct sockaddr *) &self->addr, self->addr_len);
+    if (rc == 0) {
+        self->err = 0;
+        *fd = self->fd = s;
+        return ZKERNEL_POLLOUT;
+    }
+    self->err = errno;
+    close (s);
+    if (self->err == ENOENT || self->err == ECONNREFUSED
+            || self->err == EAGAIN)
+        *timer_interval = IPC_CONNECTOR_RETRY_INTERVAL;
+    return 0;
+}
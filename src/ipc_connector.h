@@ -0,0 +1,32 @@
+//  IPC connector class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#ifndef __IPC_CONNECTOR_H_INCLUDED__
+#define __IPC_CONNECTOR_H_INCLUDED__
+
+#include "socket.h"
+#include "protocol_engine.h"
+
+//  Connects to an IPC listener and hands the connection over to a TCP
+//  session, or a shared memory session if the owner sets shm_ring_size.
+//  Retries while nobody listens on the path.
+typedef struct ipc_connector ipc_connector_t;
+
+ipc_connector_t *
+    ipc_connector_new (protocol_engine_constructor_t *protocol_engine_constructor, socket_t *owner);
+
+void
+    ipc_connector_destroy (ipc_connector_t **self_p);
+
+//  Set address to connect to; the reactor makes the connection once
+//  the connector is started. Paths are as for ipc_listener_bind.
+int
+    ipc_connector_connect (ipc_connector_t *self, const char *path);
+
+int
+    ipc_connector_errno (ipc_connector_t *self);
+
+#endif
@@ -0,0 +1,254 @@
+//  IPC listener class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "io_object.h"
+#include "ipc_listener.h"
+#include "tcp_session.h"
+#include "shm_session.h"
+#include "msg.h"
+#include "proxy.h"
+#include "reactor.h"
+#include "reactor_group.h"
+#include "socket.h"
+#include "socket_options.h"
+#include "zkernel.h"
+
+//  Time in us to stop accepting after running out of descriptors or
+//  memory; connections wait in the backlog meanwhile
+#define IPC_LISTENER_BACKOFF_INTERVAL 100000
+
+struct ipc_listener {
+    io_object_t base;
+    int fd;
+    //  Bound address, to remove the socket file
+    struct sockaddr_un addr;
+    //  Register sessions here, see socket_options.h
+    bool fast_accept;
+    //  Peers pass shared memory rings, see socket_options.h
+    bool shm;
+    protocol_engine_constructor_t *protocol_engine_constructor;
+    socket_t *owner;
+};
+
+static int
+    io_init (io_object_t *self_, io_descriptor_t *io_descriptor, int *fd, uint32_t *timer_interval);
+
+static int
+    io_event (io_object_t *self_, uint32_t flags, int *fd, uint32_t *timer_interval);
+
+static int
+    io_timeout (io_object_t *self_, int *fd, uint32_t *timer_interval);
+
+static io_object_t *
+    s_new_session (ipc_listener_t *self, int fd);
+
+static struct io_object_ops ops = {
+    .init  = io_init,
+    .event = io_event,
+    .timeout = io_timeout
+};
+
+//  Peers are nameless, so hash peer's process ID instead of its
+//  address. Connections from the same process stay together.
+
+static uint32_t
+s_peer_hash (int fd)
+{
+    struct ucred cred;
+    socklen_t cred_len = sizeof cred;
+    if (getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == 0)
+        return reactor_group_hash (&cred.pid, sizeof cred.pid);
+    else
+        return reactor_group_hash (&fd, sizeof fd);
+}
+
+ipc_listener_t *
+ipc_listener_new (protocol_engine_constructor_t *protocol_engine_constructor, socket_t *owner)
+{
+    ipc_listener_t *self = malloc (sizeof *self);
+    if (self)
+        *self = (ipc_listener_t) {
+            .base.ops = ops,
+            .fd = -1,
+            .protocol_engine_constructor = protocol_engine_constructor,
+            .owner = owner,
+        };
+    return self;
+}
+
+void
+ipc_listener_destroy (ipc_listener_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        ipc_listener_t *self = *self_p;
+        if (self->fd != -1) {
+            close (self->fd);
+            if (self->addr.sun_path [0] != '\0')
+                unlink (self->addr.sun_path);
+        }
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+int
+ipc_listener_bind (ipc_listener_t *self, const char *path)
+{
+    int rc;
+
+    assert (self);
+    assert (path);
+    if (self->fd != -1)
+        return -1;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    const size_t path_len = strlen (path);
+    if (path_len == 0 || path_len >= sizeof addr.sun_path) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy (addr.sun_path, path, path_len);
+    //  Abstract names are not NUL terminated
+    if (path [0] == '@')
+        addr.sun_path [0] = '\0';
+    const socklen_t addr_len = (socklen_t)
+        (offsetof (struct sockaddr_un, sun_path)
+            + path_len + (path [0] == '@'? 0: 1));
+
+    const int fd =
+        socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+    //  A socket file left over from an earlier run fails the bind
+    if (addr.sun_path [0] != '\0')
+        unlink (addr.sun_path);
+    rc = bind (fd, (struct sockaddr *) &addr, addr_len);
+    if (rc == -1) {
+        close (fd);
+        return -1;
+    }
+    socket_options_t *options = socket_get_options (self->owner);
+    rc = listen (fd, socket_options_backlog (options));
+    if (rc == -1) {
+        close (fd);
+        if (addr.sun_path [0] != '\0')
+            unlink (addr.sun_path);
+        return -1;
+    }
+
+    self->fd = fd;
+    self->addr = addr;
+    self->fast_accept = socket_options_fast_accept (options);
+    self->shm = socket_options_shm_ring_size (options) > 0;
+    return 0;
+}
+
+static int
+io_init (io_object_t *self_, io_descriptor_t *io_descriptor, int *fd, uint32_t *timer_interval)
+{
+    ipc_listener_t *self = (ipc_listener_t *) self_;
+    assert (self);
+
+    //  The socket was created non-blocking
+    *fd = self->fd;
+    return 3;
+}
+
+static int
+io_event (io_object_t *self_, uint32_t flags, int *fd, uint32_t *timer_interval)
+{
+    ipc_listener_t *self = (ipc_listener_t *) self_;
+    assert (self);
+
+    if ((flags & ZKERNEL_IO_ERROR) == ZKERNEL_IO_ERROR) {
+        printf ("ipc_listener: I/O error\n");
+        *fd = -1;
+        return 0;
+    }
+
+    while (1) {
+        const int rc = accept4 (
+            self->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (rc == -1) {
+            if (errno == ECONNABORTED || errno == EINTR)
+                continue;
+            //  As for TCP listeners, polling would report the pending
+            //  connection again right away
+            if (errno == EMFILE || errno == ENFILE
+                    || errno == ENOBUFS || errno == ENOMEM) {
+                *timer_interval = IPC_LISTENER_BACKOFF_INTERVAL;
+                return 0;
+            }
+            break;
+        }
+
+        const uint32_t peer_hash = s_peer_hash (rc);
+        io_object_t *session = s_new_session (self, rc);
+        if (!session)
+            continue;
+        if (self->fast_accept) {
+            if (proxy_start_session (
+                    socket_proxy (self->owner), self->base.reactor,
+                    session, peer_hash) == -1)
+                io_object_destroy (&session);
+            continue;
+        }
+        msg_t *msg = msg_new (ZKERNEL_SESSION);
+        if (msg == NULL)
+            io_object_destroy (&session);
+        else {
+            msg->u.session.session = session;
+            msg->u.session.peer_hash = peer_hash;
+            proxy_send (socket_proxy (self->owner), msg);
+        }
+    }
+    return 1 | 2 | ZKERNEL_INPUT_DRAINED;
+}
+
+//  Back-off is over; resume polling for connections
+
+static int
+io_timeout (io_object_t *self_, int *fd, uint32_t *timer_interval)
+{
+    ipc_listener_t *self = (ipc_listener_t *) self_;
+    assert (self);
+
+    return 1 | 2;
+}
+
+//  Session taking over accepted socket; closes the socket on failure
+
+static io_object_t *
+s_new_session (ipc_listener_t *self, int fd)
+{
+    if (self->shm)
+        return (io_object_t *) shm_session_new (fd, 0, self->owner);
+
+    protocol_engine_t *protocol_engine = self->protocol_engine_constructor ();
+    if (protocol_engine == NULL) {
+        close (fd);
+        return NULL;
+    }
+    tcp_session_t *session =
+        tcp_session_new (fd, protocol_engine, self->owner);
+    if (!session)
+        close (fd);
+    return (io_object_t *) session;
+}
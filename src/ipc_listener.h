@@ -0,0 +1,33 @@
+//  IPC listener class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#ifndef __IPC_LISTENER_H_INCLUDED__
+#define __IPC_LISTENER_H_INCLUDED__
+
+#include "socket.h"
+#include "protocol_engine.h"
+
+//  Listens on a Unix domain stream socket. Accepted connections run
+//  in TCP sessions, so peers speak the same protocol as over TCP, or
+//  in shared memory sessions if the owner sets shm_ring_size. There
+//  is no fallback from one to the other.
+typedef struct ipc_listener ipc_listener_t;
+
+ipc_listener_t *
+    ipc_listener_new (
+            protocol_engine_constructor_t *protocol_engine_constructor,
+            socket_t *owner);
+
+//  Removes the socket file if the listener created it
+void
+    ipc_listener_destroy (ipc_listener_t **self_p);
+
+//  Bind to path, replacing a stale socket file. A leading '@' selects
+//  the abstract namespace, which leaves nothing in the file system.
+int
+    ipc_listener_bind (ipc_listener_t *self, const char *path);
+
+#endif
@@ -0,0 +1,215 @@
+//  Mailbox class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+
+#include "atomic.h"
+#include "msg.h"
+#include "mailbox.h"
+
+//  Intrusive MPSC queue after Dmitry Vyukov. Producers swap themselves
+//  into head and then link the previous head to their message; the
+//  consumer follows next pointers from tail. The stub keeps the list
+//  non-empty so that neither side ever touches the other's end.
+
+#define MAILBOX_AWAKE       0
+#define MAILBOX_SLEEPING    1
+
+struct mailbox {
+    //  Last message pushed, written by producers
+    msg_t *head;
+    //  Next message to pop, owned by the consumer
+    msg_t *tail;
+    msg_t stub;
+    int state;
+    int fd;
+};
+
+static void
+    s_link (mailbox_t *self, msg_t *first, msg_t *last);
+
+static void
+    s_signal (mailbox_t *self);
+
+mailbox_t *
+mailbox_new ()
+{
+    mailbox_t *self = (mailbox_t *) malloc (sizeof *self);
+    if (self) {
+        *self = (mailbox_t) {
+            .state = MAILBOX_AWAKE,
+            .fd = eventfd (0, EFD_CLOEXEC)
+        };
+        if (self->fd == -1) {
+            free (self);
+            return NULL;
+        }
+        self->head = self->tail = &self->stub;
+    }
+    return self;
+}
+
+void
+mailbox_destroy (mailbox_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        mailbox_t *self = *self_p;
+        msg_t *msg;
+        while ((msg = mailbox_pop (self)))
+            msg_destroy (&msg);
+        close (self->fd);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+void
+mailbox_push (mailbox_t *self, msg_t *msg)
+{
+    assert (self);
+    assert (msg);
+    s_link (self, msg, msg);
+    s_signal (self);
+}
+
+void
+mailbox_push_batch (mailbox_t *self, msg_t *first, msg_t *last)
+{
+    assert (self);
+    assert (first);
+    assert (last);
+    s_link (self, first, last);
+    s_signal (self);
+}
+
+msg_t *
+mailbox_pop (mailbox_t *self)
+{
+    assert (self);
+
+    msg_t *tail = self->tail;
+    msg_t *next = (msg_t *) atomic_ptr_get ((void **) &tail->next);
+    if (tail == &self->stub) {
+        if (next == NULL)
+            return NULL;
+        self->tail = tail = next;
+        next = (msg_t *) atomic_ptr_get ((void **) &tail->next);
+    }
+    if (next) {
+        self->tail = next;
+        return tail;
+    }
+    //  The tail is the last message, unless a producer is linking
+    //  a new one right now
+    if (tail != atomic_ptr_get ((void **) &self->head))
+        return NULL;
+    //  Put the stub behind the tail, so we can hand the tail out
+    s_link (self, &self->stub, &self->stub);
+    next = (msg_t *) atomic_ptr_get ((void **) &tail->next);
+    if (next) {
+        self->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+bool
+mailbox_is_empty (mailbox_t *self)
+{
+    assert (self);
+    return self->tail == &self->stub
+        && atomic_ptr_get ((void **) &self->head) == &self->stub;
+}
+
+bool
+mailbox_sleep (mailbox_t *self)
+{
+    assert (self);
+    //  The swap orders the state store before the head load; paired
+    //  with the producer's swap on head, one side sees the other.
+    atomic_int_swap (&self->state, MAILBOX_SLEEPING);
+    if (mailbox_is_empty (self))
+        return true;
+    //  A producer may have signalled already; the consumer just sees
+    //  a spurious wakeup later.
+    atomic_int_set (&self->state, MAILBOX_AWAKE);
+    return false;
+}
+
+void
+mailbox_awake (mailbox_t *self)
+{
+    assert (self);
+    atomic_int_set (&self->state, MAILBOX_AWAKE);
+}
+
+msg_t *
+mailbox_wait (mailbox_t *self)
+{
+    assert (self);
+    while (true) {
+        msg_t *msg = mailbox_pop (self);
+        if (msg)
+            return msg;
+        if (mailbox_sleep (self)) {
+            uint64_t x;
+            int rc = read (self->fd, &x, sizeof x);
+            while (rc == -1) {
+                assert (errno == EINTR);
+                rc = read (self->fd, &x, sizeof x);
+            }
+            assert (rc == sizeof x);
+            mailbox_awake (self);
+        }
+    }
+}
+
+int
+mailbox_fd (mailbox_t *self)
+{
+    assert (self);
+    return self->fd;
+}
+
+void
+mailbox_reset_fd (mailbox_t *self)
+{
+    assert (self);
+    uint64_t x;
+    const int rc = read (self->fd, &x, sizeof x);
+    assert (rc == sizeof x);
+}
+
+static void
+s_link (mailbox_t *self, msg_t *first, msg_t *last)
+{
+    atomic_ptr_set ((void **) &last->next, NULL);
+    msg_t *prev = (msg_t *) atomic_ptr_swap ((void **) &self->head, last);
+    atomic_ptr_set ((void **) &prev->next, first);
+}
+
+//  Wake up the consumer if it went to sleep. Only the producer that
+//  flips the state writes the eventfd.
+
+static void
+s_signal (mailbox_t *self)
+{
+    if (atomic_int_get (&self->state) == MAILBOX_SLEEPING
+            && atomic_int_cas (
+                &self->state, MAILBOX_SLEEPING, MAILBOX_AWAKE)
+                    == MAILBOX_SLEEPING) {
+        const uint64_t v = 1;
+        const int rc = write (self->fd, &v, sizeof v);
+        assert (rc == sizeof v);
+    }
+}
@@ -0,0 +1,64 @@
+//  Mailbox class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#ifndef __MAILBOX_H_INCLUDED__
+#define __MAILBOX_H_INCLUDED__
+
+#include <stdbool.h>
+
+#include "msg.h"
+
+//  Lock-free multi-producer, single-consumer message queue. Messages
+//  are linked through msg_t.next and delivered in FIFO order. The
+//  eventfd is signalled only when a producer finds the consumer asleep.
+typedef struct mailbox mailbox_t;
+
+mailbox_t *
+    mailbox_new ();
+
+//  Destroys messages still queued
+void
+    mailbox_destroy (mailbox_t **self_p);
+
+void
+    mailbox_push (mailbox_t *self, msg_t *msg);
+
+//  Push messages first .. last, linked through next, with one atomic
+//  operation
+void
+    mailbox_push_batch (mailbox_t *self, msg_t *first, msg_t *last);
+
+//  Consumer side. Returns NULL when the mailbox is empty, or when a
+//  producer has not finished linking its message yet.
+msg_t *
+    mailbox_pop (mailbox_t *self);
+
+bool
+    mailbox_is_empty (mailbox_t *self);
+
+//  Tell producers the consumer is about to block on the eventfd.
+//  Returns false, with the consumer still awake, when messages
+//  arrived meanwhile.
+bool
+    mailbox_sleep (mailbox_t *self);
+
+//  Tell producers the consumer is draining the mailbox again
+void
+    mailbox_awake (mailbox_t *self);
+
+//  Block until a message arrives and return it
+msg_t *
+    mailbox_wait (mailbox_t *self);
+
+//  Descriptor that becomes readable when a sleeping consumer is woken
+int
+    mailbox_fd (mailbox_t *self);
+
+//  Consume the wakeup after the descriptor polled readable
+void
+    mailbox_reset_fd (mailbox_t *self);
+
+#endif
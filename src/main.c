@@ -12,10 +12,13 @@
 
 #include "dispatcher.h"
 #include "reactor.h"
+#include "reactor_group.h"
 #include "socket.h"
+#include "socket_options.h"
 #include "msg.h"
 #include "tcp_connector.h"
 #include "tcp_listener.h"
+#include "ipc_listener.h"
 #include "zmtp_handshake.h"
 
 static int
@@ -59,26 +62,71 @@ s_tcp_bind (socket_t *socket, unsigned short port)
     return 0;
 }
 
+static int
+s_ipc_bind (socket_t *socket, const char *path)
+{
+    ipc_listener_t *listener =
+        ipc_listener_new (zmtp_handshake_new_protocol_engine, socket);
+    assert (listener);
+
+    int rc = ipc_listener_bind (listener, path);
+    assert (rc == 0);
+
+    rc = socket_listen (socket, (io_object_t *) listener);
+    assert (rc != -1);
+
+    return 0;
+}
+
+//  Bind one SO_REUSEPORT listener per reactor
+
+static int
+s_tcp_bind_sharded (
+    socket_t *socket, reactor_group_t *reactors, unsigned short port)
+{
+    socket_options_set_reuseport (socket_get_options (socket), true);
+    socket_options_set_fast_accept (socket_get_options (socket), true);
+
+    for (size_t i = 0; i < reactor_group_size (reactors); i++) {
+        tcp_listener_t *listener =
+            tcp_listener_new (zmtp_handshake_new_protocol_engine, socket);
+        assert (listener);
+
+        int rc = tcp_listener_bind (listener, port);
+        assert (rc == 0);
+
+        rc = socket_listen_on (socket, (io_object_t *) listener, i);
+        assert (rc != -1);
+    }
+
+    return 0;
+}
+
 int main()
 {
-    reactor_t *reactor = reactor_new ();
-    assert (reactor);
+    reactor_group_t *reactors = reactor_group_new (2, NULL, NULL);
+    assert (reactors);
 
     dispatcher_t *dispatcher = dispatcher_new ();
     assert (dispatcher);
 
-    socket_t *socket = socket_new (dispatcher, reactor);
+    socket_t *socket = socket_new (dispatcher, reactors);
     assert (socket);
 
-    s_tcp_bind (socket, 5556);
+    if (getenv ("ZKERNEL_REUSEPORT"))
+        s_tcp_bind_sharded (socket, reactors, 5556);
+    else
+        s_tcp_bind (socket, 5556);
+    if (getenv ("ZKERNEL_IPC"))
+        s_ipc_bind (socket, getenv ("ZKERNEL_IPC"));
 
     for (int i = 0; i < 10; i++) {
         struct msg_t *msg = msg_new (0);
-        reactor_send (reactor, msg);
+        reactor_send (reactor_group_select (reactors, 0), msg);
         printf ("press any key\n");
         getchar ();
     }
     socket_destroy (&socket);
-    reactor_destroy (&reactor);
+    reactor_group_destroy (&reactors);
     return 0;
 }
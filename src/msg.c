@@ -8,12 +8,15 @@
 #include <assert.h>
 
 #include "msg.h"
+#include "pdu.h"
+#include "multipart.h"
+#include "slab.h"
 #include "zkernel.h"
 
 msg_t *
 msg_new (int msg_type)
 {
-    msg_t *self = (msg_t *) malloc (sizeof *self);
+    msg_t *self = (msg_t *) slab_alloc (sizeof *self);
     if (self)
         *self = (struct msg_t) { .msg_type = msg_type };
     return self;
@@ -25,15 +28,22 @@ msg_destroy (msg_t **self_p)
     assert (self_p);
     if (*self_p) {
         msg_t *self = *self_p;
-        free (self);
-        *self_p = NULL;
+        if (self->msg_type == ZKERNEL_MSG_TYPE_PDU)
+            pdu_destroy ((pdu_t **) self_p);
+        else
+        if (self->msg_type == ZKERNEL_MSG_TYPE_MULTIPART)
+            multipart_destroy ((multipart_t **) self_p);
+        else {
+            slab_free (self);
+            *self_p = NULL;
+        }
     }
 }
 
 kill_cmd_t *
 kill_cmd_new ()
 {
-    kill_cmd_t *cmd = (kill_cmd_t *) malloc (sizeof *cmd);
+    kill_cmd_t *cmd = (kill_cmd_t *) slab_alloc (sizeof *cmd);
     if (cmd != NULL)
         *cmd = (kill_cmd_t) { .base.msg_type = ZKERNEL_KILL };
     return cmd;
@@ -7,11 +7,14 @@
 #ifndef __MSG_H_INCLUDED__
 #define __MSG_H_INCLUDED__
 
+#include <stdint.h>
+
 #include "zkernel.h"
 #include "actor.h"
 
 struct io_object;
 struct proxy;
+struct reactor;
 
 struct msg_t {
     int msg_type;
@@ -21,6 +24,8 @@ struct msg_t {
         struct {
             struct io_object *session;
             io_descriptor_t *io_descriptor;
+            struct reactor *reactor;
+            uint32_t peer_hash;
         } session;
 
         struct {
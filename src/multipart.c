@@ -0,0 +1,80 @@
+//  Multipart message class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#include <assert.h>
+
+#include "zkernel.h"
+#include "slab.h"
+#include "multipart.h"
+
+multipart_t *
+multipart_new ()
+{
+    multipart_t *self = (multipart_t *) slab_alloc (sizeof *self);
+    if (self)
+        *self = (multipart_t) {
+            .base = { .msg_type = ZKERNEL_MSG_TYPE_MULTIPART }
+        };
+    return self;
+}
+
+void
+multipart_destroy (multipart_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        multipart_t *self = *self_p;
+        pdu_t *pdu;
+        while ((pdu = multipart_pop (self)))
+            pdu_destroy (&pdu);
+        slab_free (self);
+        *self_p = NULL;
+    }
+}
+
+void
+multipart_append (multipart_t *self, pdu_t *pdu)
+{
+    assert (self);
+    assert (pdu);
+
+    pdu->base.next = NULL;
+    pdu->flags &= ~PDU_MORE;
+    if (self->tail) {
+        self->tail->flags |= PDU_MORE;
+        self->tail->base.next = &pdu->base;
+    }
+    else
+        self->head = pdu;
+    self->tail = pdu;
+    self->parts++;
+    self->size += pdu->pdu_size;
+}
+
+pdu_t *
+multipart_pop (multipart_t *self)
+{
+    assert (self);
+
+    pdu_t *pdu = self->head;
+    if (pdu) {
+        self->head = (pdu_t *) pdu->base.next;
+        if (self->head == NULL)
+            self->tail = NULL;
+        pdu->base.next = NULL;
+        self->parts--;
+        self->size -= pdu->pdu_size;
+    }
+    return pdu;
+}
+
+bool
+multipart_too_large (multipart_t *self, size_t max_size)
+{
+    assert (self);
+    return self->parts > MULTIPART_MAX_PARTS
+        || (max_size > 0 && self->size > max_size);
+}
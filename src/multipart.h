@@ -0,0 +1,58 @@
+//  Multipart message class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#ifndef __MULTIPART_H_INCLUDED__
+#define __MULTIPART_H_INCLUDED__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "msg.h"
+#include "pdu.h"
+
+//  Most parts a message received from a peer may have
+#define MULTIPART_MAX_PARTS 65536
+
+struct io_object;
+
+//  Message made of several frames, delivered and sent as a unit.
+//  Parts are kept as a list of PDUs linked through base.next, so they
+//  are never copied into one buffer. Every part but the last carries
+//  PDU_MORE.
+struct multipart {
+    msg_t base;
+    struct io_object *io_object;
+    pdu_t *head;
+    pdu_t *tail;
+    size_t parts;
+    //  Total size of parts, in bytes
+    size_t size;
+};
+
+typedef struct multipart multipart_t;
+
+multipart_t *
+    multipart_new ();
+
+//  Destroys remaining parts
+void
+    multipart_destroy (multipart_t **self_p);
+
+//  Append part; the multipart takes ownership
+void
+    multipart_append (multipart_t *self, pdu_t *pdu);
+
+//  Remove and return first part, or NULL when there are none left
+pdu_t *
+    multipart_pop (multipart_t *self);
+
+//  True once a message being received has more than MULTIPART_MAX_PARTS
+//  parts, or more than max_size bytes unless max_size is 0. A peer
+//  could grow it without limit otherwise, one frame at a time.
+bool
+    multipart_too_large (multipart_t *self, size_t max_size);
+
+#endif
@@ -5,29 +5,103 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <assert.h>
 
+#include "atomic.h"
 #include "zkernel.h"
 #include "pdu.h"
+#include "slab.h"
 
 pdu_t *
 pdu_new ()
 {
-    pdu_t *pdu = (pdu_t *) malloc (sizeof *pdu);
+    return pdu_new_with_size (0);
+}
+
+pdu_t *
+pdu_new_with_size (size_t pdu_size)
+{
+    pdu_t *pdu = (pdu_t *) slab_alloc (sizeof *pdu);
     if (pdu) {
-        pdu->base = (msg_t) { .msg_type = ZKERNEL_MSG_TYPE_PDU };
-        pdu->pdu_size = 0;
+        *pdu = (pdu_t) {
+            .base = { .msg_type = ZKERNEL_MSG_TYPE_PDU },
+            .pdu_size = pdu_size,
+            .pdu_data = pdu->inline_data,
+        };
+        if (pdu_size > PDU_INLINE_SIZE) {
+            //  Payload follows the buffer header in the same block
+            struct pdu_buffer *buffer = NULL;
+            if (pdu_size <= SIZE_MAX - sizeof *buffer)
+                buffer = (struct pdu_buffer *)
+                    slab_alloc (sizeof *buffer + pdu_size);
+            if (buffer == NULL) {
+                slab_free (pdu);
+                return NULL;
+            }
+            *buffer = (struct pdu_buffer) {
+                .refcnt = 1,
+                .data = (uint8_t *) (buffer + 1)
+            };
+            pdu->buffer = buffer;
+            pdu->pdu_data = buffer->data;
+        }
     }
     return pdu;
 }
 
 pdu_t *
-pdu_new_with_size (size_t pdu_size)
+pdu_new_with_data (
+    void *data, size_t pdu_size, pdu_free_fn *free_fn, void *hint)
 {
-    pdu_t *pdu = (pdu_t *) malloc (sizeof *pdu);
+    pdu_t *pdu = (pdu_t *) slab_alloc (sizeof *pdu);
+    struct pdu_buffer *buffer =
+        (struct pdu_buffer *) slab_alloc (sizeof *buffer);
+    if (pdu == NULL || buffer == NULL) {
+        slab_free (pdu);
+        slab_free (buffer);
+        return NULL;
+    }
+    *buffer = (struct pdu_buffer) {
+        .refcnt = 1,
+        .free_fn = free_fn,
+        .hint = hint,
+        .data = (uint8_t *) data
+    };
+    *pdu = (pdu_t) {
+        .base = { .msg_type = ZKERNEL_MSG_TYPE_PDU },
+        .pdu_size = pdu_size,
+        .pdu_data = buffer->data,
+        .buffer = buffer,
+    };
+    return pdu;
+}
+
+pdu_t *
+pdu_share (pdu_t *self)
+{
+    assert (self);
+
+    if (self->buffer == NULL) {
+        pdu_t *pdu = pdu_new_with_size (self->pdu_size);
+        if (pdu) {
+            pdu->flags = self->flags;
+            memcpy (pdu->pdu_data, self->pdu_data, self->pdu_size);
+        }
+        return pdu;
+    }
+
+    pdu_t *pdu = (pdu_t *) slab_alloc (sizeof *pdu);
     if (pdu) {
-        pdu->base = (msg_t) { .msg_type = ZKERNEL_MSG_TYPE_PDU };
-        pdu->pdu_size = pdu_size;
+        atomic_int_add (&self->buffer->refcnt, 1);
+        *pdu = (pdu_t) {
+            .base = { .msg_type = ZKERNEL_MSG_TYPE_PDU },
+            .flags = self->flags,
+            .pdu_size = self->pdu_size,
+            .pdu_data = self->pdu_data,
+            .buffer = self->buffer,
+        };
     }
     return pdu;
 }
@@ -37,8 +111,14 @@ pdu_destroy (pdu_t **self_p)
 {
     assert (self_p);
     if (*self_p) {
-          pdu_t *self = *self_p;
-          free (self);
-          *self_p = NULL;
+        pdu_t *self = *self_p;
+        struct pdu_buffer *buffer = self->buffer;
+        if (buffer && atomic_int_add (&buffer->refcnt, -1) == 1) {
+            if (buffer->free_fn)
+                buffer->free_fn (buffer->data, buffer->hint);
+            slab_free (buffer);
+        }
+        slab_free (self);
+        *self_p = NULL;
     }
 }
@@ -12,13 +12,40 @@
 
 #include "msg.h"
 
+//  Payloads up to this size are stored in the PDU itself
+#define PDU_INLINE_SIZE 64
+
+//  Flags
+//  More frames of the same message follow
+#define PDU_MORE        1
+
 struct io_object;
+struct inproc_pipe;
+
+//  Releases a user supplied payload
+typedef void (pdu_free_fn) (void *data, void *hint);
+
+//  Out-of-line payload, shared by reference count. The payload is
+//  freed when the last PDU referring to it is destroyed.
+struct pdu_buffer {
+    int refcnt;
+    //  NULL when the payload was allocated along with the buffer
+    pdu_free_fn *free_fn;
+    void *hint;
+    uint8_t *data;
+};
 
 struct pdu {
     msg_t base;
     struct io_object *io_object;
+    //  In-process pipe the PDU travels through, to give back credit
+    struct inproc_pipe *pipe;
+    uint32_t flags;
     size_t pdu_size;
-    uint8_t pdu_data [64];
+    //  Points to inline_data or into buffer
+    uint8_t *pdu_data;
+    struct pdu_buffer *buffer;
+    uint8_t inline_data [PDU_INLINE_SIZE];
 };
 
 typedef struct pdu pdu_t;
@@ -26,9 +53,25 @@ typedef struct pdu pdu_t;
 pdu_t *
     pdu_new ();
 
+//  Create PDU with room for pdu_size bytes of payload. Returns NULL
+//  when out of memory, or when pdu_size is too large to allocate.
 pdu_t *
     pdu_new_with_size (size_t pdu_size);
 
+//  Create PDU carrying the user buffer without copying it. The PDU
+//  takes ownership; free_fn, if not NULL, is called with data and
+//  hint when the last reference goes away.
+pdu_t *
+    pdu_new_with_data (
+        void *data, size_t pdu_size, pdu_free_fn *free_fn, void *hint);
+
+//  Create PDU sharing the payload of given PDU, for sending the same
+//  message to many sessions. Out-of-line payloads are not copied and
+//  must not be modified once shared.
+pdu_t *
+    pdu_share (pdu_t *self);
+
+//  Destroy PDU, releasing its reference to the payload
 void
     pdu_destroy (pdu_t **self_p);
 
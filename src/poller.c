@@ -0,0 +1,32 @@
+//  Poller interface
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "poller.h"
+
+extern inline void
+poller_add (poller_t *self, poller_registration_t *reg, int fd, void *udata);
+
+extern inline int
+poller_arm (poller_t *self, poller_registration_t *reg, int event_mask);
+
+extern inline void
+poller_remove (poller_t *self, poller_registration_t *reg);
+
+extern inline int
+poller_wait (poller_t *self, poller_event_t *events, int max_events, int64_t timeout);
+
+void
+poller_destroy (poller_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        poller_t *self = *self_p;
+        self->ops.destroy (self_p);
+    }
+}
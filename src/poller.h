@@ -0,0 +1,100 @@
+//  Poller interface
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#ifndef __POLLER_H_INCLUDED__
+#define __POLLER_H_INCLUDED__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//  Keep registration armed after it reports an event
+#define POLLER_PERSISTENT       0x80
+//  Report readiness transitions only; implies POLLER_PERSISTENT
+#define POLLER_EDGE_TRIGGERED   0x40
+
+typedef struct poller poller_t;
+
+typedef struct poller_event poller_event_t;
+
+typedef struct poller_registration poller_registration_t;
+
+struct poller_event {
+    void *udata;
+    //  ZKERNEL_INPUT_READY, ZKERNEL_OUTPUT_READY, ZKERNEL_IO_ERROR
+    uint32_t flags;
+};
+
+//  Poller state for one descriptor. The caller embeds it in its own
+//  object, so registering does not allocate; only the poller touches
+//  the fields.
+struct poller_registration {
+    int fd;
+    void *udata;
+    //  Requested event mask, including POLLER_PERSISTENT
+    int event_mask;
+    //  Epoll: descriptor has been added to the epoll set
+    bool added;
+    //  io_uring: mask of the poll request in flight
+    int poll_mask;
+    //  io_uring: poll request in flight
+    bool active;
+    //  io_uring: cancellation of the request in flight was submitted
+    bool cancelling;
+};
+
+//  A registration is created unarmed. Arming it with a mask of
+//  ZKERNEL_POLLIN and ZKERNEL_POLLOUT bits makes the poller report
+//  the next event on the descriptor, after which the registration
+//  is unarmed again unless POLLER_PERSISTENT is set. Arming with
+//  an empty mask disarms the registration.
+
+struct poller_ops {
+    void (*add) (poller_t *self, poller_registration_t *reg, int fd, void *udata);
+    int (*arm) (poller_t *self, poller_registration_t *reg, int event_mask);
+    void (*remove) (poller_t *self, poller_registration_t *reg);
+    int (*wait) (poller_t *self, poller_event_t *events, int max_events, int64_t timeout);
+    void (*destroy) (poller_t **self_p);
+};
+
+struct poller {
+    struct poller_ops ops;
+};
+
+typedef poller_t *(poller_constructor_t) ();
+
+//  Register descriptor, setting up the registration
+inline void
+poller_add (poller_t *self, poller_registration_t *reg, int fd, void *udata)
+{
+    self->ops.add (self, reg, fd, udata);
+}
+
+inline int
+poller_arm (poller_t *self, poller_registration_t *reg, int event_mask)
+{
+    return self->ops.arm (self, reg, event_mask);
+}
+
+//  Unregister descriptor. The registration may be freed or added
+//  again right away.
+inline void
+poller_remove (poller_t *self, poller_registration_t *reg)
+{
+    self->ops.remove (self, reg);
+}
+
+//  Wait for events; timeout is in ns, -1 waits forever. Returns
+//  number of events stored, or -1 on error.
+inline int
+poller_wait (poller_t *self, poller_event_t *events, int max_events, int64_t timeout)
+{
+    return self->ops.wait (self, events, max_events, timeout);
+}
+
+void
+    poller_destroy (poller_t **self_p);
+
+#endif
@@ -29,6 +29,17 @@ protocol_engine_write (protocol_engine_t *self, iobuf_t *iobuf, protocol_engine_
 extern inline int
 protocol_engine_write_advance (protocol_engine_t *self, size_t n, protocol_engine_info_t *info);
 
+int
+protocol_engine_iovec (protocol_engine_t *self, struct iovec *iov, int iovcnt)
+{
+    assert (self);
+
+    if (self->ops.iovec)
+        return self->ops.iovec (self, iov, iovcnt);
+    else
+        return -1;
+}
+
 int
 protocol_engine_set_socket_id (protocol_engine_t *self, const char *socket_id)
 {
@@ -40,6 +51,18 @@ protocol_engine_set_socket_id (protocol_engine_t *self, const char *socket_id)
         return 0;
 }
 
+int
+protocol_engine_set_max_msg_size (
+    protocol_engine_t *self, size_t max_msg_size)
+{
+    assert (self);
+
+    if (self->ops.set_max_msg_size)
+        return self->ops.set_max_msg_size (self, max_msg_size);
+    else
+        return 0;
+}
+
 int
 protocol_engine_next (protocol_engine_t **self_p, protocol_engine_info_t *info)
 {
@@ -8,6 +8,7 @@
 #define __PROTOCOL_ENGINE_H_INCLUDED__
 
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "iobuf.h"
 #include "pdu.h"
@@ -24,7 +25,9 @@ struct protocol_engine_ops {
     pdu_t *(*decode) (protocol_engine_t *self, protocol_engine_info_t *info);
     int (*write) (protocol_engine_t *self, iobuf_t *iobuf, protocol_engine_info_t *info);
     int (*write_advance) (protocol_engine_t *self, size_t n, protocol_engine_info_t *info);
+    int (*iovec) (protocol_engine_t *self, struct iovec *iov, int iovcnt);
     int (*set_socket_id) (protocol_engine_t *self, const char *socket_id);
+    int (*set_max_msg_size) (protocol_engine_t *self, size_t max_msg_size);
     int (*next) (protocol_engine_t **self_p, protocol_engine_info_t *info);
     void (*destroy) (protocol_engine_t **self_p);
 };
@@ -85,9 +88,24 @@ protocol_engine_write_advance (protocol_engine_t *self, size_t n, protocol_engin
     return self->ops.write_advance (self, n, info);
 }
 
+//  Describe pending output, which may span several frames, as an
+//  iovec list for a single sendmsg. Written bytes are reported with
+//  protocol_engine_read_advance. Returns number of entries filled,
+//  or -1 when the engine does not support vectored output.
+int
+    protocol_engine_iovec (
+        protocol_engine_t *self, struct iovec *iov, int iovcnt);
+
 int
     protocol_engine_set_socket_id (protocol_engine_t *self, const char *socket_id);
 
+//  Make the engine fail on incoming frames longer than max_msg_size
+//  bytes; 0 means no limit. Applies to this stage only, so set it
+//  again after protocol_engine_next.
+int
+    protocol_engine_set_max_msg_size (
+        protocol_engine_t *self, size_t max_msg_size);
+
 int
     protocol_engine_next (protocol_engine_t **self_p, protocol_engine_info_t *info);
 
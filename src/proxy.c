@@ -11,6 +11,7 @@
 #include "actor.h"
 #include "dispatcher.h"
 #include "reactor.h"
+#include "reactor_group.h"
 #include "proxy.h"
 #include "io_object.h"
 #include "zkernel.h"
@@ -19,7 +20,7 @@ struct proxy {
     actor_t *socket;
     io_descriptor_t *(*session_allocator) ();
     dispatcher_t *dispatcher;
-    reactor_t *reactor;
+    reactor_group_t *reactors;
     struct actor actor_ifc;
 };
 
@@ -27,7 +28,7 @@ static int
     s_enqueue_msg (void *self_, struct msg_t *msg);
 
 proxy_t *
-proxy_new (actor_t *socket, io_descriptor_t *(*object_allocator) (), dispatcher_t *dispatcher, reactor_t *reactor)
+proxy_new (actor_t *socket, io_descriptor_t *(*object_allocator) (), dispatcher_t *dispatcher, reactor_group_t *reactors)
 {
     proxy_t *self = (proxy_t *) malloc (sizeof *self);
     if (self) {
@@ -35,7 +36,7 @@ proxy_new (actor_t *socket, io_descriptor_t *(*object_allocator) (), dispatcher_
             .socket = socket,
             .session_allocator = object_allocator,
             .dispatcher = dispatcher,
-            .reactor = reactor,
+            .reactors = reactors,
             .actor_ifc = {
                 .object = self,
                 .ftab = { .send = s_enqueue_msg },
@@ -68,9 +69,41 @@ s_enqueue_msg (void *self_, msg_t *msg)
 void
 proxy_send (proxy_t *self, msg_t *msg)
 {
+    msg->proxy = self;
     dispatcher_send (self->dispatcher, msg);
 }
 
+int
+proxy_start_session (
+    proxy_t *self, reactor_t *reactor,
+    io_object_t *session, uint32_t peer_hash)
+{
+    assert (self);
+    assert (session);
+
+    msg_t *msg = msg_new (ZKERNEL_SESSION);
+    if (msg == NULL)
+        return -1;
+    io_descriptor_t *io_descriptor = self->session_allocator ();
+    if (io_descriptor == NULL) {
+        msg_destroy (&msg);
+        return -1;
+    }
+    const int rc = reactor_start_io (reactor, session, io_descriptor);
+    if (rc == -1) {
+        free (io_descriptor);
+        msg_destroy (&msg);
+        return -1;
+    }
+
+    msg->u.session.session = session;
+    msg->u.session.io_descriptor = io_descriptor;
+    msg->u.session.reactor = reactor;
+    msg->u.session.peer_hash = peer_hash;
+    actor_send (self->socket, msg);
+    return 0;
+}
+
 static void
 s_session (proxy_t *self, msg_t *msg)
 {
@@ -81,11 +114,18 @@ s_session (proxy_t *self, msg_t *msg)
     msg_t *msg2 = msg_new (ZKERNEL_START_IO);
 
     if (io_descriptor && msg2) {
+        //  Sessions from sharded listeners stay where they were accepted
+        reactor_t *reactor = msg->u.session.reactor;
+        if (reactor == NULL)
+            reactor = reactor_group_select (
+                self->reactors, msg->u.session.peer_hash);
+        msg->u.session.io_descriptor = io_descriptor;
+        msg->u.session.reactor = reactor;
         actor_send (self->socket, msg);
         msg2->u.start_io.io_object = session;
         msg2->u.start_io.io_descriptor = io_descriptor;
         msg2->u.start_io.reply_to = self->actor_ifc;
-        reactor_send (self->reactor, msg2);
+        reactor_send (reactor, msg2);
     }
     else {
         free (io_descriptor);
@@ -10,17 +10,27 @@
 #include "msg.h"
 #include "actor.h"
 #include "dispatcher.h"
-#include "reactor.h"
+#include "reactor_group.h"
 #include "zkernel.h"
 
+struct io_object;
+
 typedef struct proxy proxy_t;
 
 proxy_t *
-    proxy_new (actor_t *socket, io_descriptor_t *(*session_alocator) (), dispatcher_t *dispatcher, reactor_t *reactor);
+    proxy_new (actor_t *socket, io_descriptor_t *(*session_alocator) (), dispatcher_t *dispatcher, reactor_group_t *reactors);
 
 void
     proxy_send (proxy_t *self, msg_t *msg);
 
+//  Start session on reactor, which must be the calling one, then let
+//  the socket know. The session may be serving I/O before the socket
+//  hears about it. On failure the session is left to the caller.
+int
+    proxy_start_session (
+        proxy_t *self, reactor_t *reactor,
+        struct io_object *session, uint32_t peer_hash);
+
 void
     proxy_destroy (proxy_t **self_p);
 
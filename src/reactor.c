@@ -4,44 +4,56 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
 
+#define _GNU_SOURCE
+
 #include <assert.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
-#include <sys/eventfd.h>
 #include <errno.h>
-#include <sys/epoll.h>
 #include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
+#include <stddef.h>
 
 #include "atomic.h"
 #include "reactor.h"
 #include "io_object.h"
+#include "iobuf_pool.h"
+#include "event_source.h"
 #include "msg.h"
+#include "mailbox.h"
 #include "clock.h"
 #include "zkernel.h"
 #include "pdu.h"
+#include "multipart.h"
+#include "timer_wheel.h"
+#include "poller.h"
+#include "epoll_poller.h"
+#include "io_uring_poller.h"
 
-struct event_source {
-    int fd;
-    uint64_t timer;
-    uint32_t event_mask;
-    io_object_t *io_object;
-    io_descriptor_t *io_descriptor;
-};
-
-struct timer {
-    uint64_t t;
-    struct event_source *ev_src;
-};
+#define EVENT_SOURCE(timer_ptr) \
+    ((struct event_source *) \
+        ((char *) (timer_ptr) - offsetof (struct event_source, timer)))
 
 struct reactor {
-    int poll_fd;
-    int ctrl_fd;
+    poller_t *poller;
     struct event_source controler;
-    void *mbox;
+    mailbox_t *mbox;
     pthread_t thread_handle;
-    struct timer timers [8];
+    timer_wheel_t *timer_wheel;
+    //  Session buffers, lent out while data is in flight
+    iobuf_pool_t *iobuf_pool;
+    //  Time in us, sampled once per loop iteration
+    uint64_t now;
+    int load;
+    bool edge_triggered;
+    //  Time in ns to busy poll before blocking
+    uint64_t spin_budget;
+    reactor_stats_t stats;
+    struct event_source *pending;
+    uint32_t msg_budget;
+    uint32_t event_budget;
 };
 
 static void *
@@ -50,36 +62,83 @@ static void *
 static void
     s_start_io (reactor_t *self, msg_t *msg);
 
+static int
+    s_register (
+        reactor_t *self, io_object_t *io_object, io_descriptor_t *io_descriptor);
+
 static void
     s_stop_io (reactor_t *self, msg_t *msg);
 
+static uint32_t
+    s_ready_flags (struct event_source *ev_src);
+
+static void
+    s_dispatch (reactor_t *self, struct event_source *ev_src, uint32_t flags);
+
 static void
     s_update_event_source (
-        reactor_t *self, struct event_source *ev_src, int fd, int event_mask);
+        reactor_t *self, struct event_source *ev_src, int fd, int rc);
+
+static void
+    s_pending_remove (reactor_t *self, struct event_source *ev_src);
 
-static struct timer *
-    s_alloc_timer (reactor_t *self);
+static void
+    s_stats_add (uint64_t *counter, uint64_t value);
 
 static void
-    s_free_timer (struct timer *timer);
+    s_stats_record (uint64_t *histogram, uint64_t value);
 
-struct timer *
-    s_next_timer (reactor_t *self);
+static void
+    s_pending_prepend (reactor_t *self, struct event_source *list);
 
-struct timer *
-    s_find_timer (reactor_t *self, struct event_source *ev_src);
+static bool
+    s_process_msg (reactor_t *self, msg_t *msg);
+
+static int
+    s_busy_poll (
+        reactor_t *self, poller_event_t *events, int max_events);
 
 reactor_t *
 reactor_new ()
 {
-    int poll_fd = 1, ctrl_fd = -1, rc;
+    return reactor_new_with_options (NULL);
+}
+
+reactor_t *
+reactor_new_with_options (const reactor_options_t *options)
+{
+    const reactor_options_t defaults = {
+        .backend = REACTOR_BACKEND_EPOLL,
+        .edge_triggered = false,
+        .buffer_pool_size = REACTOR_BUFFER_POOL_SIZE,
+    };
+    if (options == NULL)
+        options = &defaults;
+
+    //  Before the first reading of the clock in the new thread
+    clock_calibrate ();
+
+    poller_t *poller = NULL;
+    mailbox_t *mbox = NULL;
+    int rc;
+    timer_wheel_t *timer_wheel = NULL;
+    iobuf_pool_t *iobuf_pool = NULL;
     reactor_t *self = NULL;
 
-    poll_fd = epoll_create (1);
-    if (poll_fd == -1)
+    if (options->backend == REACTOR_BACKEND_IO_URING)
+        poller = io_uring_poller_new_poller ();
+    else
+        poller = epoll_poller_new_poller ();
+    if (!poller)
+        goto fail;
+    mbox = mailbox_new ();
+    if (!mbox)
+        goto fail;
+    timer_wheel = timer_wheel_new (clock_now_us ());
+    if (!timer_wheel)
         goto fail;
-    ctrl_fd = eventfd (0, 0);
-    if (ctrl_fd == -1)
+    iobuf_pool = iobuf_pool_new (options->buffer_pool_size);
+    if (!iobuf_pool)
         goto fail;
     self = malloc (sizeof *self);
     if (!self)
@@ -87,15 +146,28 @@ reactor_new ()
 
     //  Register event descriptor.
     *self = (reactor_t) {
-        .poll_fd = poll_fd,
-        .ctrl_fd = ctrl_fd,
-        .controler = { .fd = ctrl_fd, .event_mask = EPOLLIN }
+        .poller = poller,
+        .controler = {
+            .fd = mailbox_fd (mbox),
+            .event_mask = ZKERNEL_POLLIN | POLLER_PERSISTENT
+        },
+        .mbox = mbox,
+        .timer_wheel = timer_wheel,
+        .iobuf_pool = iobuf_pool,
+        //  io_uring requests are oneshot; re-arming them costs no
+        //  syscall, so edge-triggered mode is an epoll feature.
+        .edge_triggered =
+            options->edge_triggered
+            && options->backend == REACTOR_BACKEND_EPOLL,
+        .spin_budget = options->spin_budget * 1000ull,
+        .msg_budget = options->msg_budget,
+        .event_budget = options->event_budget,
     };
-    struct epoll_event ev = {
-        .events = EPOLLIN,
-        .data = &self->controler
-    };
-    rc = epoll_ctl (poll_fd, EPOLL_CTL_ADD, ctrl_fd, &ev);
+    poller_add (
+        poller, &self->controler.registration,
+        self->controler.fd, &self->controler);
+    rc = poller_arm (
+        poller, &self->controler.registration, self->controler.event_mask);
     assert (rc == 0);
 
     //  Create and start I/O thread
@@ -105,10 +177,12 @@ reactor_new ()
     return self;
 
 fail:
-    if (ctrl_fd != -1)
-        close (ctrl_fd);
-    if (poll_fd != -1)
-        close (poll_fd);
+    timer_wheel_destroy (&timer_wheel);
+    iobuf_pool_destroy (&iobuf_pool);
+    if (self)
+        poller_remove (poller, &self->controler.registration);
+    mailbox_destroy (&mbox);
+    poller_destroy (&poller);
     if (self)
         free (self);
     return NULL;
@@ -124,8 +198,11 @@ reactor_destroy (reactor_t **self_p)
         assert (cmd);
         reactor_send (self, (msg_t *) cmd);
         pthread_join (self->thread_handle, NULL);
-        close (self->poll_fd);
-        close (self->ctrl_fd);
+        poller_remove (self->poller, &self->controler.registration);
+        poller_destroy (&self->poller);
+        mailbox_destroy (&self->mbox);
+        timer_wheel_destroy (&self->timer_wheel);
+        iobuf_pool_destroy (&self->iobuf_pool);
         free (self);
         *self_p = NULL;
     }
@@ -139,170 +216,235 @@ s_loop (void *udata)
 
     int stop = 0;
 #define MAX_EVENTS 32
-    struct epoll_event events [MAX_EVENTS];
-
-    uint64_t now = clock_now ();
+    poller_event_t events [MAX_EVENTS];
+    //  Events not fetched stay queued in the kernel
+    const int max_events =
+        self->event_budget > 0 && self->event_budget < MAX_EVENTS
+            ? (int) self->event_budget: MAX_EVENTS;
+
+    uint64_t busy_since = clock_now_ns ();
+    self->now = busy_since / 1000;
     while (!stop) {
-        struct timer *next_timer = s_next_timer (self);
-        const int max_wait =
-            next_timer == NULL
-                ? -1
-                : (next_timer->t < now? 0: next_timer->t - now);
-        const int nfds = epoll_wait (
-            self->poll_fd, events, MAX_EVENTS, max_wait);
-        now = clock_now ();
+        s_stats_add (&self->stats.loop_iterations, 1);
+        int64_t max_wait = -1;
+        const uint64_t next_expiry =
+            timer_wheel_next_expiry (self->timer_wheel);
+        if (next_expiry <= self->now || self->pending
+                || !mailbox_is_empty (self->mbox))
+            max_wait = 0;
+        else
+        if (next_expiry != UINT64_MAX)
+            max_wait = next_expiry - self->now < INT64_MAX / 1000
+                ? (int64_t) (next_expiry - self->now) * 1000: INT64_MAX;
+        int nfds = 0;
+        const uint64_t idle_since = clock_now_ns ();
+        s_stats_add (&self->stats.busy_time, idle_since - busy_since);
+        if (max_wait == 0)
+            nfds = poller_wait (self->poller, events, max_events, 0);
+        else {
+            if (self->spin_budget > 0)
+                nfds = s_busy_poll (self, events, max_events);
+            //  Producers signal the eventfd only while we are asleep
+            if (nfds == 0 && mailbox_sleep (self->mbox)) {
+                nfds = poller_wait (
+                    self->poller, events, max_events, max_wait);
+                mailbox_awake (self->mbox);
+            }
+        }
+        busy_since = clock_now_ns ();
+        self->now = busy_since / 1000;
+        s_stats_add (&self->stats.idle_time, busy_since - idle_since);
         if (nfds == -1) {
             assert (errno == EINTR);
             continue;
         }
-        bool msg_flag = false;
+        s_stats_add (&self->stats.events, nfds);
+        s_stats_record (self->stats.events_per_wait, nfds);
         for (int i = 0; i < nfds; i++) {
-            const uint32_t what = events [i].events;
             struct event_source *ev_src =
-                (struct event_source *) events [i].data.ptr;
-            if (ev_src->fd == self->ctrl_fd)
-                msg_flag = true;
+                (struct event_source *) events [i].udata;
+            if (ev_src == &self->controler)
+                mailbox_reset_fd (self->mbox);
+            else
+            if (self->edge_triggered) {
+                ev_src->ready |= events [i].flags;
+                const uint32_t flags = s_ready_flags (ev_src);
+                ev_src->ready &= ~ZKERNEL_IO_ERROR;
+                if (flags != 0)
+                    s_dispatch (self, ev_src, flags);
+            }
             else {
-                uint32_t flags = 0;
-                if ((what & EPOLLIN) == EPOLLIN)
-                    flags |= ZKERNEL_INPUT_READY;
-                if ((what & EPOLLOUT) == EPOLLOUT)
-                    flags |= ZKERNEL_OUTPUT_READY;
-                if ((what & (EPOLLERR | EPOLLHUP)) != 0)
-                    flags |= ZKERNEL_IO_ERROR;
-                int fd = ev_src->fd;
-                uint32_t timer_interval = 0;
-                const int rc = io_object_event (
-                    ev_src->io_object, flags, &fd, &timer_interval);
+                //  Oneshot registration is disarmed now
                 ev_src->event_mask = 0;
-                s_update_event_source (self, ev_src, fd, rc);
-                if (timer_interval > 0) {
-                    struct timer *timer = NULL;
-                    if (ev_src->timer != 0)
-                        timer = s_find_timer (self, ev_src);
-                    else
-                        timer = s_alloc_timer (self);
-                    timer->t = now + timer_interval;
-                    timer->ev_src = ev_src;
-                    ev_src->timer = timer->t;
-                }
+                s_dispatch (self, ev_src, events [i].flags);
+            }
+        }
+        //  Serve readiness left unconsumed by previous iterations.
+        //  Sources still not drained are queued again, behind any
+        //  that become ready in the meantime.
+        uint32_t dispatched = (uint32_t) nfds;
+        struct event_source *ev_src = self->pending;
+        self->pending = NULL;
+        while (ev_src) {
+            if (self->event_budget > 0 && dispatched >= self->event_budget)
+                break;
+            struct event_source *next = ev_src->next_pending;
+            ev_src->pending = false;
+            ev_src->prev_pending = ev_src->next_pending = NULL;
+            if (next)
+                next->prev_pending = NULL;
+            const uint32_t flags = s_ready_flags (ev_src);
+            if (flags != 0) {
+                s_dispatch (self, ev_src, flags);
+                dispatched++;
             }
+            ev_src = next;
         }
-        struct timer *timer = s_next_timer (self);
-        while (timer && timer->t <= now) {
-            struct event_source *ev_src = timer->ev_src;
-            assert (ev_src);
+        //  Sources over budget go first next time
+        if (ev_src)
+            s_pending_prepend (self, ev_src);
+        struct timer *timer;
+        while ((timer = timer_wheel_expire (self->timer_wheel, self->now))) {
+            struct event_source *ev_src = EVENT_SOURCE (timer);
             int fd = ev_src->fd;
             uint32_t timer_interval = 0;
+            const uint64_t start = clock_now_ns ();
             const int rc = io_object_timeout (
                 ev_src->io_object, &fd, &timer_interval);
+            s_stats_record (
+                self->stats.timeout_time, clock_now_ns () - start);
+            s_stats_add (&self->stats.timers_fired, 1);
             s_update_event_source (self, ev_src, fd, rc);
-            if (timer_interval > 0) {
-                timer->t = now + timer_interval;
-                timer->ev_src = ev_src;
-                ev_src->timer = timer->t;
-            }
-            else
-                s_free_timer (timer);
-            timer = s_next_timer (self);
+            if (timer_interval > 0)
+                timer_wheel_add (
+                    self->timer_wheel, &ev_src->timer,
+                    self->now + timer_interval);
         }
-        if (msg_flag) {
-            struct msg_t *msg =
-                (struct msg_t *) atomic_ptr_swap (&self->mbox, NULL);
-            assert (msg);
-            uint64_t x;
-            const int rc = read (self->ctrl_fd, &x, sizeof x);
-            assert (rc == sizeof x);
-            //  Transform LIFO to FIFO
-            msg_t *prev = NULL;
-            while (msg->next) {
-                msg_t *next = msg->next;
-                msg->next = prev;
-                prev = msg;
-                msg = next;
-            }
-            msg->next = prev;
-            while (msg) {
-                struct msg_t *next_msg = msg->next;
-                if (msg->msg_type == ZKERNEL_MSG_TYPE_PDU) {
-                    pdu_t *pdu = (pdu_t *) msg;
-                    io_object_t *io_object = pdu->io_object;
-                    struct event_source *ev_src =
-                        (struct event_source *) io_object->io_handle;
-                    const int rc = io_object_message (io_object, msg);
-                    s_update_event_source (self, ev_src, ev_src->fd, rc);
-                }
-                else
-                if (msg->msg_type == ZKERNEL_KILL) {
-                    msg_destroy (&msg);
-                    stop = 1;
-                }
-                else
-                if (msg->msg_type == ZKERNEL_START_IO) {
-                    actor_t reply_to = msg->u.start_io.reply_to;
-                    s_start_io (self, msg);
-                    actor_send (&reply_to, msg);
-                }
-                else
-                if (msg->msg_type == ZKERNEL_STOP_IO) {
-                    actor_t reply_to = msg->u.stop_io.reply_to;
-                    s_stop_io (self, msg);
-                    actor_send (&reply_to, msg);
-                }
-                else
-                    msg_destroy (&msg);
-                msg = next_msg;
-            }
+        //  Messages over budget stay in the mailbox; the loop does not
+        //  block while there are any.
+        uint32_t processed = 0;
+        while (self->msg_budget == 0 || processed < self->msg_budget) {
+            msg_t *msg = mailbox_pop (self->mbox);
+            if (msg == NULL)
+                break;
+            if (s_process_msg (self, msg))
+                stop = 1;
+            processed++;
+        }
+        if (processed > 0) {
+            s_stats_add (&self->stats.messages, processed);
+            s_stats_record (self->stats.mailbox_batch, processed);
         }
     }
 
+    //  Messages that arrived after the kill command are dropped
+    //  along with the mailbox.
+
     return NULL;
 }
 
+//  Returns true when the message asks the reactor to stop
+
+static bool
+s_process_msg (reactor_t *self, msg_t *msg)
+{
+    if (msg->msg_type == ZKERNEL_MSG_TYPE_PDU
+            || msg->msg_type == ZKERNEL_MSG_TYPE_MULTIPART) {
+        io_object_t *io_object = msg->msg_type == ZKERNEL_MSG_TYPE_PDU
+            ? ((pdu_t *) msg)->io_object
+            : ((multipart_t *) msg)->io_object;
+        struct event_source *ev_src =
+            (struct event_source *) io_object->io_handle;
+        const uint64_t start = clock_now_ns ();
+        const int rc = io_object_message (io_object, msg);
+        s_stats_record (self->stats.message_time, clock_now_ns () - start);
+        s_update_event_source (self, ev_src, ev_src->fd, rc);
+    }
+    else
+    if (msg->msg_type == ZKERNEL_KILL) {
+        msg_destroy (&msg);
+        return true;
+    }
+    else
+    if (msg->msg_type == ZKERNEL_START_IO) {
+        actor_t reply_to = msg->u.start_io.reply_to;
+        s_start_io (self, msg);
+        actor_send (&reply_to, msg);
+    }
+    else
+    if (msg->msg_type == ZKERNEL_STOP_IO) {
+        actor_t reply_to = msg->u.stop_io.reply_to;
+        s_stop_io (self, msg);
+        actor_send (&reply_to, msg);
+    }
+    else
+        msg_destroy (&msg);
+
+    return false;
+}
+
 static void
 s_start_io (reactor_t *self, msg_t *msg)
 {
     assert (self);
 
-    io_object_t *io_object = msg->u.start_io.io_object;
+    io_descriptor_t *io_descriptor = msg->u.start_io.io_descriptor;
+    if (s_register (self, msg->u.start_io.io_object, io_descriptor) == 0) {
+        msg->msg_type = ZKERNEL_START_IO_ACK;
+        msg->u.start_io_ack.io_descriptor = io_descriptor;
+    }
+    else {
+        atomic_int_add (&self->load, -1);
+        msg->msg_type = ZKERNEL_START_IO_NAK;
+        msg->u.start_io_nak.io_descriptor = io_descriptor;
+    }
+}
+
+int
+reactor_start_io (
+    reactor_t *self, io_object_t *io_object, io_descriptor_t *io_descriptor)
+{
+    assert (self);
+    assert (pthread_equal (pthread_self (), self->thread_handle));
 
-    struct event_source *ev_src = malloc (sizeof *ev_src);
-    io_object->io_handle = ev_src;
+    atomic_int_add (&self->load, 1);
+    const int rc = s_register (self, io_object, io_descriptor);
+    if (rc == -1)
+        atomic_int_add (&self->load, -1);
+    return rc;
+}
 
-    if (ev_src == NULL)
-        goto error;
+//  Set up event source and initialise I/O object. Returns -1 when the
+//  object comes up with neither a descriptor nor a timer; connectors
+//  may start out waiting to retry.
 
+static int
+s_register (
+    reactor_t *self, io_object_t *io_object, io_descriptor_t *io_descriptor)
+{
+    struct event_source *ev_src = &io_object->event_source;
     *ev_src = (struct event_source) {
         .fd = -1,
+        .registration.fd = -1,
         .io_object = io_object,
-        .io_descriptor = msg->u.start_io.io_descriptor,
+        .io_descriptor = io_descriptor,
     };
+    io_object->io_handle = ev_src;
+    io_object->reactor = self;
+    io_object->iobuf_pool = self->iobuf_pool;
 
     int fd = -1;
     uint32_t timer_interval = 0;
     const int rc = io_object_init (
-        io_object, msg->u.start_io.io_descriptor, &fd, &timer_interval);
-    if (fd == -1)
-        goto error;
+        io_object, io_descriptor, &fd, &timer_interval);
+    if (fd == -1 && timer_interval == 0)
+        return -1;
 
     s_update_event_source (self, ev_src, fd, rc);
-    if (timer_interval > 0) {
-        struct timer *timer = s_alloc_timer (self);
-        assert (timer);
-        timer->t = clock_now () + timer_interval;
-        timer->ev_src = ev_src;
-        ev_src->timer = timer->t;
-    }
-
-    msg->msg_type = ZKERNEL_START_IO_ACK;
-    msg->u.start_io_ack.io_descriptor = ev_src->io_descriptor;
-    return;
-
-error:
-    if (ev_src)
-        free (ev_src);
-    msg->msg_type = ZKERNEL_START_IO_NAK;
-    msg->u.start_io_nak.io_descriptor = ev_src->io_descriptor;
+    if (timer_interval > 0)
+        timer_wheel_add (
+            self->timer_wheel, &ev_src->timer, self->now + timer_interval);
+    return 0;
 }
 
 static void
@@ -312,18 +454,11 @@ s_stop_io (reactor_t *self, msg_t *msg)
         (struct event_source *) msg->u.stop_io.io_handle;
     assert (ev_src);
 
-    if (ev_src->fd != -1) {
-        struct epoll_event ev;
-        const int rc = epoll_ctl (
-            self->poll_fd, EPOLL_CTL_DEL, ev_src->fd, &ev);
-        assert (rc == 0);
-    }
-    if (ev_src->timer > 0) {
-        struct timer *timer = s_find_timer (self, ev_src);
-        assert (timer);
-        s_free_timer (timer);
-    }
-    free (ev_src);
+    if (ev_src->fd != -1)
+        poller_remove (self->poller, &ev_src->registration);
+    s_pending_remove (self, ev_src);
+    timer_wheel_cancel (self->timer_wheel, &ev_src->timer);
+    atomic_int_add (&self->load, -1);
 
     msg->msg_type = ZKERNEL_STOP_IO_ACK;
 }
@@ -331,91 +466,229 @@ s_stop_io (reactor_t *self, msg_t *msg)
 void
 reactor_send (reactor_t *self, struct msg_t *msg)
 {
-    void *tail = atomic_ptr_get (&self->mbox);
-    atomic_ptr_set ((void **) &msg->next, tail);
-    void *prev = atomic_ptr_cas (&self->mbox, tail, msg);
-    while (prev != tail) {
-        tail = prev;
-        atomic_ptr_set ((void **) &msg->next, tail);
-        prev = atomic_ptr_cas (&self->mbox, tail, msg);
+    //  Count I/O objects from the moment they are handed over, so that
+    //  placement decisions see sessions still in flight.
+    if (msg->msg_type == ZKERNEL_START_IO)
+        atomic_int_add (&self->load, 1);
+
+    mailbox_push (self->mbox, msg);
+}
+
+void
+reactor_send_batch (reactor_t *self, struct msg_t *head, struct msg_t *tail)
+{
+    assert (self);
+    assert (head);
+    assert (tail);
+
+    int start_io = 0;
+    for (msg_t *msg = head; msg != tail; msg = msg->next)
+        if (msg->msg_type == ZKERNEL_START_IO)
+            start_io++;
+    if (tail->msg_type == ZKERNEL_START_IO)
+        start_io++;
+    if (start_io > 0)
+        atomic_int_add (&self->load, start_io);
+
+    mailbox_push_batch (self->mbox, head, tail);
+}
+
+int
+reactor_set_affinity (reactor_t *self, int cpu)
+{
+    assert (self);
+
+    cpu_set_t cpu_set;
+    CPU_ZERO (&cpu_set);
+    CPU_SET (cpu, &cpu_set);
+    const int rc = pthread_setaffinity_np (
+        self->thread_handle, sizeof cpu_set, &cpu_set);
+    return rc == 0? 0: -1;
+}
+
+int
+reactor_load (reactor_t *self)
+{
+    assert (self);
+    return atomic_int_get (&self->load);
+}
+
+void
+reactor_stats (reactor_t *self, reactor_stats_t *stats)
+{
+    assert (self);
+    assert (stats);
+    //  Counter by counter; the struct holds nothing else
+    const uint64_t *counters = (const uint64_t *) &self->stats;
+    for (size_t i = 0; i < sizeof *stats / sizeof *counters; i++)
+        ((uint64_t *) stats) [i] =
+            __atomic_load_n (&counters [i], __ATOMIC_RELAXED);
+
+    iobuf_pool_stats_t pool_stats;
+    iobuf_pool_stats (self->iobuf_pool, &pool_stats);
+    stats->buffers_in_use = pool_stats.buffers_in_use;
+    stats->buffer_bytes_in_use = pool_stats.bytes_in_use;
+    stats->buffers_cached = pool_stats.buffers_cached;
+    stats->buffer_bytes_cached = pool_stats.bytes_cached;
+}
+
+//  Only the reactor thread writes counters, but any thread may read
+//  them. Relaxed atomic stores keep each one whole, at the cost of a
+//  plain store.
+
+static void
+s_stats_add (uint64_t *counter, uint64_t value)
+{
+    __atomic_store_n (counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+static void
+s_stats_record (uint64_t *histogram, uint64_t value)
+{
+    int bucket = value? 64 - __builtin_clzll (value): 0;
+    if (bucket >= REACTOR_STATS_BUCKETS)
+        bucket = REACTOR_STATS_BUCKETS - 1;
+    s_stats_add (&histogram [bucket], 1);
+}
+
+//  Poll without blocking until an event arrives, the mailbox gets
+//  a message or the spin budget is spent. Returns number of events
+//  or -1, like poller_wait.
+
+static int
+s_busy_poll (
+    reactor_t *self, poller_event_t *events, int max_events)
+{
+    const uint64_t deadline = clock_now_ns () + self->spin_budget;
+    while (true) {
+        const int nfds = poller_wait (self->poller, events, max_events, 0);
+        if (nfds != 0)
+            return nfds;
+        if (!mailbox_is_empty (self->mbox))
+            return 0;
+        if (clock_now_ns () >= deadline)
+            return 0;
+        atomic_pause ();
     }
-    //  Wake up I/O thread if necessary
-    if (!prev) {
-        uint64_t v = 1;
-        const int rc = write (self->ctrl_fd, &v, sizeof v);
-        assert (rc == sizeof v);
+}
+
+//  Return readiness flags the I/O object is interested in
+
+static uint32_t
+s_ready_flags (struct event_source *ev_src)
+{
+    uint32_t flags = ev_src->ready & ZKERNEL_IO_ERROR;
+    if ((ev_src->event_mask & ZKERNEL_POLLIN) == ZKERNEL_POLLIN)
+        flags |= ev_src->ready & ZKERNEL_INPUT_READY;
+    if ((ev_src->event_mask & ZKERNEL_POLLOUT) == ZKERNEL_POLLOUT)
+        flags |= ev_src->ready & ZKERNEL_OUTPUT_READY;
+    return flags;
+}
+
+static void
+s_dispatch (reactor_t *self, struct event_source *ev_src, uint32_t flags)
+{
+    int fd = ev_src->fd;
+    uint32_t timer_interval = 0;
+    const uint64_t start = clock_now_ns ();
+    const int rc = io_object_event (
+        ev_src->io_object, flags, &fd, &timer_interval);
+    s_stats_record (self->stats.event_time, clock_now_ns () - start);
+    s_update_event_source (self, ev_src, fd, rc);
+    if (timer_interval > 0)
+        timer_wheel_add (
+            self->timer_wheel, &ev_src->timer, self->now + timer_interval);
+}
+
+static void
+s_pending_add (reactor_t *self, struct event_source *ev_src)
+{
+    if (!ev_src->pending) {
+        ev_src->prev_pending = NULL;
+        ev_src->next_pending = self->pending;
+        if (self->pending)
+            self->pending->prev_pending = ev_src;
+        self->pending = ev_src;
+        ev_src->pending = true;
+    }
+}
+
+static void
+s_pending_remove (reactor_t *self, struct event_source *ev_src)
+{
+    if (ev_src->pending) {
+        if (ev_src->prev_pending)
+            ev_src->prev_pending->next_pending = ev_src->next_pending;
+        else
+            self->pending = ev_src->next_pending;
+        if (ev_src->next_pending)
+            ev_src->next_pending->prev_pending = ev_src->prev_pending;
+        ev_src->prev_pending = ev_src->next_pending = NULL;
+        ev_src->pending = false;
     }
 }
 
+//  Put a detached chain of pending sources in front of the list
+
+static void
+s_pending_prepend (reactor_t *self, struct event_source *list)
+{
+    struct event_source *tail = list;
+    while (tail->next_pending)
+        tail = tail->next_pending;
+    tail->next_pending = self->pending;
+    if (self->pending)
+        self->pending->prev_pending = tail;
+    list->prev_pending = NULL;
+    self->pending = list;
+}
+
+//  Apply the value returned by an I/O object callback: the poll
+//  flags it is interested in and, in edge-triggered mode, the
+//  readiness it has consumed.
+
 static void
 s_update_event_source (
-    reactor_t *self, struct event_source *ev_src, int fd, int event_mask)
+    reactor_t *self, struct event_source *ev_src, int fd, int rc)
 {
+    const int event_mask = rc & (ZKERNEL_POLLIN | ZKERNEL_POLLOUT);
+
     if (fd != ev_src->fd) {
-        if (ev_src->fd != -1) {
-            struct epoll_event ev = {};
-            const int rc = epoll_ctl (
-                self->poll_fd, EPOLL_CTL_DEL, ev_src->fd, &ev);
-            assert (rc == 0 || errno == EBADF || errno == ENOENT);
-        }
+        if (ev_src->fd != -1)
+            poller_remove (self->poller, &ev_src->registration);
+        ev_src->ready = 0;
         if (fd != -1) {
-            struct epoll_event ev = { .data = ev_src };
-            if ((event_mask & ZKERNEL_POLLIN) == ZKERNEL_POLLIN)
-                ev.events |= EPOLLIN | EPOLLONESHOT;
-            if ((event_mask & ZKERNEL_POLLOUT) == ZKERNEL_POLLOUT)
-                ev.events |= EPOLLOUT | EPOLLONESHOT;
-            const int rc = epoll_ctl (
-                self->poll_fd, EPOLL_CTL_ADD, fd, &ev);
+            poller_add (self->poller, &ev_src->registration, fd, ev_src);
+            //  Edge-triggered registrations watch both directions
+            //  for the lifetime of the descriptor.
+            const int rc = poller_arm (
+                self->poller, &ev_src->registration,
+                self->edge_triggered
+                    ? ZKERNEL_POLLIN | ZKERNEL_POLLOUT | POLLER_EDGE_TRIGGERED
+                    : event_mask);
             assert (rc == 0);
         }
         ev_src->fd = fd;
-        ev_src->event_mask = event_mask;
+    }
+    else
+    if (self->edge_triggered) {
+        if (rc != -1 && (rc & ZKERNEL_INPUT_DRAINED) != 0)
+            ev_src->ready &= ~ZKERNEL_INPUT_READY;
+        if (rc != -1 && (rc & ZKERNEL_OUTPUT_DRAINED) != 0)
+            ev_src->ready &= ~ZKERNEL_OUTPUT_READY;
     }
     else
     if (ev_src->event_mask != event_mask) {
-        struct epoll_event ev = { .data = ev_src };
-        if ((event_mask & ZKERNEL_POLLIN) == ZKERNEL_POLLIN)
-            ev.events |= EPOLLIN | EPOLLONESHOT;
-        if ((event_mask & ZKERNEL_POLLOUT) == ZKERNEL_POLLOUT)
-            ev.events |= EPOLLOUT | EPOLLONESHOT;
-        const int rc = epoll_ctl (
-            self->poll_fd, EPOLL_CTL_MOD, fd, &ev);
+        const int rc = poller_arm (
+            self->poller, &ev_src->registration, event_mask);
         assert (rc == 0);
-        ev_src->event_mask = event_mask;
     }
-}
+    ev_src->event_mask = event_mask;
 
-struct timer *
-s_alloc_timer (reactor_t *self)
-{
-    for (int i = 0; i < 8; i++) {
-        if (self->timers [i].t == 0)
-            return self->timers + i;
+    if (self->edge_triggered) {
+        if (s_ready_flags (ev_src) != 0)
+            s_pending_add (self, ev_src);
+        else
+            s_pending_remove (self, ev_src);
     }
-    return NULL;
-}
-
-void
-s_free_timer (struct timer *timer)
-{
-    timer->t = 0;
-}
-
-struct timer *
-s_next_timer (reactor_t *self)
-{
-    struct timer *timer = self->timers;
-    for (int i = 1; i < 8; i++)
-        if (timer->t < self->timers [i].t)
-            timer = self->timers + i;
-    return timer->t > 0? timer: NULL;
-}
-
-struct timer *
-s_find_timer (reactor_t *self, struct event_source *ev_src)
-{
-    for (int i = 0; i < 8; i++)
-        if (self->timers [i].ev_src == ev_src)
-            return self->timers + 1;
-    return NULL;
 }
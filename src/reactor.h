@@ -7,18 +7,122 @@
 #ifndef __REACTOR_H_INCLUDED__
 #define __REACTOR_H_INCLUDED__
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "actor.h"
+#include "zkernel.h"
+
+struct io_object;
+
+#define REACTOR_BACKEND_EPOLL       0
+#define REACTOR_BACKEND_IO_URING    1
+
+//  Default for reactor_options.buffer_pool_size
+#define REACTOR_BUFFER_POOL_SIZE    (4 * 1024 * 1024)
 
 typedef struct reactor reactor_t;
 
+typedef struct reactor_options reactor_options_t;
+
+struct reactor_options {
+    //  Readiness notification mechanism, REACTOR_BACKEND_*
+    int backend;
+    //  Register descriptors once, edge-triggered, and track readiness
+    //  in the reactor. I/O objects must then report readiness they
+    //  consumed with ZKERNEL_INPUT_DRAINED and ZKERNEL_OUTPUT_DRAINED.
+    //  Only the epoll backend honours it.
+    bool edge_triggered;
+    //  Time in us to keep polling the mailbox and descriptors before
+    //  blocking, 0 to block straight away. Trades a busy core for
+    //  lower wakeup latency.
+    uint32_t spin_budget;
+    //  Maximum number of mailbox messages processed per loop
+    //  iteration, 0 for no limit. The rest is carried over.
+    uint32_t msg_budget;
+    //  Maximum number of I/O events dispatched per loop iteration,
+    //  0 for no limit (beyond the internal batch of 32).
+    uint32_t event_budget;
+    //  Bytes of idle session buffers kept for reuse, 0 to free
+    //  buffers as soon as sessions hand them back.
+    size_t buffer_pool_size;
+};
+
+#define REACTOR_STATS_BUCKETS   32
+
+typedef struct reactor_stats reactor_stats_t;
+
+//  Histograms are log2 scaled: bucket 0 counts zero values, bucket
+//  i counts values in [2^(i-1), 2^i) and the last bucket collects
+//  everything above. Times are in ns.
+struct reactor_stats {
+    uint64_t loop_iterations;
+    uint64_t events;
+    uint64_t messages;
+    uint64_t timers_fired;
+    //  Time spent waiting for (or spinning on) events and messages
+    uint64_t idle_time;
+    //  Time spent everywhere else
+    uint64_t busy_time;
+    uint64_t events_per_wait [REACTOR_STATS_BUCKETS];
+    uint64_t mailbox_batch [REACTOR_STATS_BUCKETS];
+    uint64_t event_time [REACTOR_STATS_BUCKETS];
+    uint64_t message_time [REACTOR_STATS_BUCKETS];
+    uint64_t timeout_time [REACTOR_STATS_BUCKETS];
+    //  Session buffers lent out; idle sessions hold none, so these
+    //  over reactor_load give the buffer memory per session
+    uint64_t buffers_in_use;
+    uint64_t buffer_bytes_in_use;
+    //  Idle buffers kept for reuse
+    uint64_t buffers_cached;
+    uint64_t buffer_bytes_cached;
+};
+
 reactor_t *
     reactor_new ();
 
+//  Create reactor with given options; NULL selects the defaults.
+//  Returns NULL when the requested backend is not supported.
+reactor_t *
+    reactor_new_with_options (const reactor_options_t *options);
+
 void
     reactor_destroy (reactor_t **self_p);
 
 void
     reactor_send (reactor_t *self, struct msg_t *msg);
 
+//  Send messages head .. tail, linked through next, in one atomic
+//  operation, waking the reactor at most once
+void
+    reactor_send_batch (
+        reactor_t *self, struct msg_t *head, struct msg_t *tail);
+
+//  Register I/O object with the reactor directly, without the
+//  START_IO round trip. Only valid on the reactor's own thread, i.e.
+//  from a callback of another I/O object. Returns -1 if the object
+//  fails to initialise; it is not registered then.
+int
+    reactor_start_io (
+        reactor_t *self, struct io_object *io_object,
+        io_descriptor_t *io_descriptor);
+
+//  Pin reactor thread to given CPU
+int
+    reactor_set_affinity (reactor_t *self, int cpu);
+
+//  Return number of I/O objects registered with or being started
+//  on reactor
+int
+    reactor_load (reactor_t *self);
+
+//  Copy statistics collected since reactor was created. Safe from any
+//  thread: every counter is read whole, with a relaxed atomic load,
+//  but counters are not read at one instant, so they may disagree
+//  slightly, e.g. events against the events_per_wait histogram.
+void
+    reactor_stats (reactor_t *self, reactor_stats_t *stats);
+
 #endif
 
@@ -0,0 +1,143 @@
+//  Reactor group class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "atomic.h"
+#include "reactor.h"
+#include "reactor_group.h"
+
+struct reactor_group {
+    size_t size;
+    reactor_t **reactors;
+    reactor_group_policy_t *policy;
+    int next;
+};
+
+reactor_group_t *
+reactor_group_new (
+    size_t size, const int *cpus, const reactor_options_t *options)
+{
+    assert (size > 0);
+
+    reactor_group_t *self = (reactor_group_t *) malloc (sizeof *self);
+    if (!self)
+        return NULL;
+    *self = (reactor_group_t) {
+        .size = size,
+        .reactors = (reactor_t **) calloc (size, sizeof (reactor_t *)),
+        .policy = reactor_group_round_robin,
+    };
+    if (self->reactors == NULL) {
+        free (self);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        self->reactors [i] = reactor_new_with_options (options);
+        if (self->reactors [i] == NULL)
+            goto fail;
+        if (cpus && cpus [i] >= 0)
+            if (reactor_set_affinity (self->reactors [i], cpus [i]) == -1)
+                goto fail;
+    }
+
+    return self;
+
+fail:
+    reactor_group_destroy (&self);
+    return NULL;
+}
+
+void
+reactor_group_destroy (reactor_group_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        reactor_group_t *self = *self_p;
+        for (size_t i = 0; i < self->size; i++)
+            reactor_destroy (&self->reactors [i]);
+        free (self->reactors);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+size_t
+reactor_group_size (reactor_group_t *self)
+{
+    assert (self);
+    return self->size;
+}
+
+reactor_t *
+reactor_group_reactor (reactor_group_t *self, size_t index)
+{
+    assert (self);
+    assert (index < self->size);
+    return self->reactors [index];
+}
+
+void
+reactor_group_set_policy (reactor_group_t *self, reactor_group_policy_t *policy)
+{
+    assert (self);
+    assert (policy);
+    self->policy = policy;
+}
+
+reactor_t *
+reactor_group_select (reactor_group_t *self, uint32_t hint)
+{
+    assert (self);
+
+    const size_t index = self->policy (self, hint);
+    assert (index < self->size);
+    return self->reactors [index];
+}
+
+//  FNV-1a hash
+
+uint32_t
+reactor_group_hash (const void *data, size_t size)
+{
+    const uint8_t *ptr = (const uint8_t *) data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= ptr [i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+size_t
+reactor_group_round_robin (reactor_group_t *self, uint32_t hint)
+{
+    const unsigned int n = (unsigned int) atomic_int_add (&self->next, 1);
+    return n % self->size;
+}
+
+size_t
+reactor_group_least_loaded (reactor_group_t *self, uint32_t hint)
+{
+    size_t index = 0;
+    int min_load = reactor_load (self->reactors [0]);
+    for (size_t i = 1; i < self->size; i++) {
+        const int load = reactor_load (self->reactors [i]);
+        if (load < min_load) {
+            min_load = load;
+            index = i;
+        }
+    }
+    return index;
+}
+
+size_t
+reactor_group_peer_hash (reactor_group_t *self, uint32_t hint)
+{
+    return hint % self->size;
+}
@@ -0,0 +1,54 @@
+//  Reactor group class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#ifndef __REACTOR_GROUP_H_INCLUDED__
+#define __REACTOR_GROUP_H_INCLUDED__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "reactor.h"
+
+typedef struct reactor_group reactor_group_t;
+
+//  Placement policy; returns index of the reactor that should host
+//  a new I/O object. The hint is a hash of the peer address, or 0
+//  when there is no peer yet.
+typedef size_t (reactor_group_policy_t) (reactor_group_t *self, uint32_t hint);
+
+//  Create group of reactors. When cpus is not NULL, reactor i is
+//  pinned to cpus [i]; negative entries leave the reactor unpinned.
+//  Options are applied to every reactor and may be NULL.
+reactor_group_t *
+    reactor_group_new (
+        size_t size, const int *cpus, const reactor_options_t *options);
+
+void
+    reactor_group_destroy (reactor_group_t **self_p);
+
+size_t
+    reactor_group_size (reactor_group_t *self);
+
+reactor_t *
+    reactor_group_reactor (reactor_group_t *self, size_t index);
+
+//  Set placement policy; must be called before the group is shared.
+void
+    reactor_group_set_policy (
+        reactor_group_t *self, reactor_group_policy_t *policy);
+
+reactor_t *
+    reactor_group_select (reactor_group_t *self, uint32_t hint);
+
+uint32_t
+    reactor_group_hash (const void *data, size_t size);
+
+reactor_group_policy_t
+    reactor_group_round_robin,
+    reactor_group_least_loaded,
+    reactor_group_peer_hash;
+
+#endif
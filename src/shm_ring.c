@@ -0,0 +1,211 @@
+//  Shared memory ring class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "atomic.h"
+#include "shm_ring.h"
+
+//  Record header flag: rest of the data area is unused, the next
+//  record starts at offset 0
+#define SHM_RING_WRAP   0x80000000u
+
+//  Control block in shared memory. Positions run freely and wrap at
+//  2^32; head and tail sit on cache lines of their own.
+struct shm_ring_control {
+    //  Start of the first unreleased record, advanced by the consumer
+    int head;
+    uint8_t pad1 [60];
+    //  End of the last published record, advanced by the producer
+    int tail;
+    uint8_t pad2 [60];
+};
+
+//  Records are 8-byte aligned, so a header always fits before the end
+struct shm_ring_record {
+    uint32_t size;
+    uint32_t flags;
+};
+
+struct shm_ring {
+    struct shm_ring_control *control;
+    uint8_t *data;
+    unsigned int size;
+    //  Producer: tail of records written; consumer: head of records read
+    unsigned int pos;
+    //  Producer: last head seen; consumer: last tail seen
+    unsigned int peer_pos;
+};
+
+shm_ring_t *
+shm_ring_new (void *control, void *data, size_t size)
+{
+    assert (sizeof (struct shm_ring_control) == SHM_RING_CONTROL_SIZE);
+    assert (control);
+    assert (data);
+    assert (size >= 2 * sizeof (struct shm_ring_record));
+    assert ((size & (size - 1)) == 0);
+
+    shm_ring_t *self = (shm_ring_t *) malloc (sizeof *self);
+    if (self) {
+        struct shm_ring_control *ctl = (struct shm_ring_control *) control;
+        *self = (shm_ring_t) {
+            .control = ctl,
+            .data = (uint8_t *) data,
+            .size = (unsigned int) size,
+        };
+        //  Start where the other end is; both positions are equal
+        //  unless the ring is in use already
+        self->pos = (unsigned int) atomic_int_get (&ctl->head);
+        self->peer_pos = self->pos;
+    }
+    return self;
+}
+
+void
+shm_ring_destroy (shm_ring_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        shm_ring_t *self = *self_p;
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+//  Any record up to half the ring fits once the consumer catches up,
+//  wherever the tail is
+
+size_t
+shm_ring_max_size (shm_ring_t *self)
+{
+    assert (self);
+    return self->size / 2 - sizeof (struct shm_ring_record);
+}
+
+int
+shm_ring_write (
+    shm_ring_t *self, uint32_t flags, const void *data, size_t size)
+{
+    assert (self);
+    assert ((flags & SHM_RING_WRAP) == 0);
+
+    if (size > shm_ring_max_size (self)) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    const unsigned int record_size =
+        sizeof (struct shm_ring_record) + (((unsigned int) size + 7) & ~7u);
+    const unsigned int offset = self->pos & (self->size - 1);
+    const unsigned int to_end = self->size - offset;
+    const unsigned int needed =
+        to_end < record_size? to_end + record_size: record_size;
+    if (self->pos - self->peer_pos + needed > self->size) {
+        self->peer_pos =
+            (unsigned int) atomic_int_get (&self->control->head);
+        if (self->pos - self->peer_pos + needed > self->size) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+
+    if (to_end < record_size) {
+        const struct shm_ring_record wrap = { .flags = SHM_RING_WRAP };
+        memcpy (self->data + offset, &wrap, sizeof wrap);
+        self->pos += to_end;
+    }
+    uint8_t *ptr = self->data + (self->pos & (self->size - 1));
+    const struct shm_ring_record record = {
+        .size = (uint32_t) size,
+        .flags = flags
+    };
+    memcpy (ptr, &record, sizeof record);
+    memcpy (ptr + sizeof record, data, size);
+    self->pos += record_size;
+    return 0;
+}
+
+//  The swap orders record stores before the tail store, and the tail
+//  store before the caller's check whether the consumer is parked.
+
+void
+shm_ring_publish (shm_ring_t *self)
+{
+    assert (self);
+    atomic_int_swap (&self->control->tail, (int) self->pos);
+}
+
+int
+shm_ring_read (
+    shm_ring_t *self, uint32_t *flags, const void **data, size_t *size)
+{
+    assert (self);
+
+    if (self->pos == self->peer_pos) {
+        self->peer_pos =
+            (unsigned int) atomic_int_get (&self->control->tail);
+        if (self->pos == self->peer_pos) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+
+    //  Copy header out; the producer may scribble on shared memory
+    struct shm_ring_record record;
+    unsigned int offset = self->pos & (self->size - 1);
+    memcpy (&record, self->data + offset, sizeof record);
+    if ((record.flags & SHM_RING_WRAP) != 0) {
+        self->pos += self->size - offset;
+        offset = 0;
+        //  Wrap markers are published together with their record
+        if (self->pos == self->peer_pos) {
+            errno = EPROTO;
+            return -1;
+        }
+        memcpy (&record, self->data, sizeof record);
+    }
+    if (record.size > shm_ring_max_size (self)) {
+        errno = EPROTO;
+        return -1;
+    }
+    const unsigned int record_size =
+        sizeof record + ((record.size + 7) & ~7u);
+    if (record_size > self->peer_pos - self->pos
+            || record_size > self->size - offset) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    *flags = record.flags;
+    *data = self->data + offset + sizeof record;
+    *size = record.size;
+    self->pos += record_size;
+    return 0;
+}
+
+//  The swap orders the reads of released records before the head
+//  store, and the head store before the caller's check whether the
+//  producer is parked.
+
+void
+shm_ring_release (shm_ring_t *self)
+{
+    assert (self);
+    atomic_int_swap (&self->control->head, (int) self->pos);
+}
+
+bool
+shm_ring_readable (shm_ring_t *self)
+{
+    assert (self);
+    if (self->pos != self->peer_pos)
+        return true;
+    self->peer_pos = (unsigned int) atomic_int_get (&self->control->tail);
+    return self->pos != self->peer_pos;
+}
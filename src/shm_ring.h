@@ -0,0 +1,62 @@
+//  Shared memory ring class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#ifndef __SHM_RING_H_INCLUDED__
+#define __SHM_RING_H_INCLUDED__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//  Bytes of shared memory taken by a ring's control block
+#define SHM_RING_CONTROL_SIZE   128
+
+//  Single-producer, single-consumer ring of variable-size records in
+//  memory shared between processes. Each process holds a view on its
+//  end. Records written are invisible to the consumer until the
+//  producer publishes them, and space read is not reused until the
+//  consumer releases it, so either side can batch.
+typedef struct shm_ring shm_ring_t;
+
+//  Create view on ring with given control block and data area. Size
+//  must be a power of two. Fresh shared memory is a valid empty ring.
+shm_ring_t *
+    shm_ring_new (void *control, void *data, size_t size);
+
+void
+    shm_ring_destroy (shm_ring_t **self_p);
+
+//  Largest record payload the ring takes
+size_t
+    shm_ring_max_size (shm_ring_t *self);
+
+//  Producer side. Copy record into the ring. Returns -1 with errno set
+//  to EAGAIN when the ring is full, or to EMSGSIZE when the record can
+//  never fit.
+int
+    shm_ring_write (
+        shm_ring_t *self, uint32_t flags, const void *data, size_t size);
+
+//  Make records written so far visible to the consumer
+void
+    shm_ring_publish (shm_ring_t *self);
+
+//  Consumer side. Return next record, which stays valid until it is
+//  released. Returns -1 with errno set to EAGAIN when the ring is
+//  empty, or to EPROTO when the producer wrote garbage.
+int
+    shm_ring_read (
+        shm_ring_t *self, uint32_t *flags, const void **data, size_t *size);
+
+//  Give space of records read so far back to the producer
+void
+    shm_ring_release (shm_ring_t *self);
+
+//  True when published records are waiting to be read
+bool
+    shm_ring_readable (shm_ring_t *self);
+
+#endif
@@ -0,0 +1,747 @@
+//  Shared memory session class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+
+#include "atomic.h"
+#include "io_object.h"
+#include "shm_ring.h"
+#include "shm_session.h"
+#include "msg.h"
+#include "msg_queue.h"
+#include "multipart.h"
+#include "pdu.h"
+#include "socket.h"
+#include "socket_options.h"
+#include "zkernel.h"
+
+#define SHM_SESSION_MAGIC       0x7a6b7368
+#define SHM_SESSION_VERSION     1
+
+//  Bounds for the ring size offered by the connecting side
+#define SHM_RING_MIN_SIZE       4096
+#define SHM_RING_MAX_SIZE       (1u << 30)
+
+//  Records taken off the ring per event, so that a busy peer does
+//  not starve other sessions on the reactor
+#define SHM_SESSION_READ_BATCH  256
+
+//  Layout of the shared memory: header, control blocks of both rings,
+//  then the data areas, page aligned. Ring 0 carries messages from the
+//  connecting side, ring 1 from the accepting side.
+#define SHM_CONTROL_OFFSET      64
+#define SHM_DATA_OFFSET         4096
+
+struct shm_header {
+    uint32_t magic;
+    uint32_t ring_size;
+    //  Side sleeps and wants its eventfd signalled
+    int parked [2];
+    //  Side has gone away
+    int closed [2];
+};
+
+//  Sent over the Unix domain socket with the descriptors
+struct shm_setup {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ring_size;
+};
+
+struct shm_session {
+    io_object_t base;
+    //  Unix domain socket. Once the rings are set up nothing is sent
+    //  over it any more; it only tells when the peer goes away.
+    int fd;
+    //  Eventfds signalled to wake this side and the peer
+    int efd;
+    int peer_efd;
+    //  Epoll set of the eventfd and the socket, polled while running
+    int pfd;
+    //  Shared memory, until it is passed to the peer
+    int memfd;
+    //  0 on the connecting side, 1 on the accepting side
+    int side;
+    bool setup_sent;
+    bool running;
+    size_t ring_size;
+    struct shm_header *header;
+    size_t map_size;
+    shm_ring_t *tx;
+    shm_ring_t *rx;
+    io_descriptor_t *io_descriptor;
+    msg_queue_t *msg_queue;
+    //  Multipart message being received
+    multipart_t *inbound;
+    //  Parts of the multipart message being sent
+    multipart_t *outbound;
+    //  Next part to go out, waiting for room in the ring
+    pdu_t *pending;
+    //  Messages in msg_queue, and the most it may hold
+    uint32_t queued;
+    uint32_t sndhwm;
+    //  Longest frame or message accepted from the peer, see
+    //  socket_options.h
+    size_t max_msg_size;
+    socket_t *owner;
+};
+
+static int
+    s_setup (shm_session_t *self);
+
+static int
+    s_map (shm_session_t *self, int memfd);
+
+static int
+    s_poll_set (shm_session_t *self);
+
+static int
+    s_run (shm_session_t *self);
+
+static int
+    s_input (shm_session_t *self);
+
+static int
+    s_output (shm_session_t *self);
+
+static bool
+    s_fits (shm_session_t *self, msg_t *msg);
+
+static void
+    s_signal (shm_session_t *self);
+
+static void
+    s_ring (int efd);
+
+static int
+    s_send_setup (shm_session_t *self, const int *fds, size_t nfds);
+
+static int
+    s_recv_setup (
+        shm_session_t *self, struct shm_setup *setup, int *fds, size_t *nfds);
+
+static struct io_object_ops io_ops;
+
+shm_session_t *
+shm_session_new (int fd, size_t ring_size, socket_t *owner)
+{
+    shm_session_t *self = (shm_session_t *) malloc (sizeof *self);
+    if (!self) {
+        close (fd);
+        return NULL;
+    }
+    *self = (shm_session_t) {
+        .base = (io_object_t) { .ops = io_ops },
+        .fd = fd,
+        .efd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC),
+        .peer_efd = -1,
+        .pfd = -1,
+        .memfd = -1,
+        .side = ring_size > 0? 0: 1,
+        .ring_size = ring_size,
+        .msg_queue = msg_queue_new (),
+        .sndhwm = socket_options_sndhwm (socket_get_options (owner)),
+        .max_msg_size =
+            socket_options_max_msg_size (socket_get_options (owner)),
+        .owner = owner
+    };
+    if (self->efd == -1 || self->msg_queue == NULL)
+        goto error;
+    if (ring_size > 0) {
+        if (ring_size < SHM_RING_MIN_SIZE || ring_size > SHM_RING_MAX_SIZE
+                || (ring_size & (ring_size - 1)) != 0)
+            goto error;
+        //  Sealed, so that neither side can pull the memory from under
+        //  the other
+        self->memfd =
+            memfd_create ("zkernel-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (self->memfd == -1)
+            goto error;
+        if (ftruncate (self->memfd, SHM_DATA_OFFSET + 2 * ring_size) == -1
+                || fcntl (self->memfd, F_ADD_SEALS,
+                    F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1
+                || s_map (self, self->memfd) == -1)
+            goto error;
+        self->header->magic = SHM_SESSION_MAGIC;
+        self->header->ring_size = (uint32_t) ring_size;
+    }
+    return self;
+
+error:
+    shm_session_destroy (&self);
+    return NULL;
+}
+
+void
+shm_session_destroy (shm_session_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        shm_session_t *self = *self_p;
+        if (self->header && self->running) {
+            //  Wake the peer to find us gone
+            atomic_int_swap (&self->header->closed [self->side], 1);
+            s_ring (self->peer_efd);
+        }
+        if (self->header)
+            munmap (self->header, self->map_size);
+        shm_ring_destroy (&self->tx);
+        shm_ring_destroy (&self->rx);
+        if (self->fd != -1)
+            close (self->fd);
+        if (self->efd != -1)
+            close (self->efd);
+        if (self->peer_efd != -1)
+            close (self->peer_efd);
+        if (self->pfd != -1)
+            close (self->pfd);
+        if (self->memfd != -1)
+            close (self->memfd);
+        if (self->msg_queue)
+            msg_queue_destroy (&self->msg_queue);
+        multipart_destroy (&self->inbound);
+        multipart_destroy (&self->outbound);
+        pdu_destroy (&self->pending);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+static void
+s_destroy (io_object_t **self_p)
+{
+    shm_session_destroy ((shm_session_t **) self_p);
+}
+
+static void
+s_send_session_closed (shm_session_t *self)
+{
+    msg_t *msg = msg_new (ZKERNEL_SESSION_CLOSED);
+    assert (msg);
+    msg->u.session_closed.io_descriptor = self->io_descriptor;
+    socket_send_msg (self->owner, msg);
+}
+
+static int
+s_io_init (io_object_t *self_, io_descriptor_t *io_descriptor, int *fd, uint32_t *timer_interval)
+{
+    shm_session_t *self = (shm_session_t *) self_;
+    assert (self);
+
+    self->io_descriptor = io_descriptor;
+
+    *fd = self->fd;
+    return self->side == 0? ZKERNEL_POLLOUT: ZKERNEL_POLLIN;
+}
+
+static int
+s_io_event (io_object_t *self_, uint32_t io_flags, int *fd, uint32_t *timer_interval)
+{
+    shm_session_t *self = (shm_session_t *) self_;
+    assert (self);
+
+    if (!self->running) {
+        //  Reading the socket tells whether an error flag is fatal;
+        //  the answer may be waiting ahead of it.
+        const int rc = s_setup (self);
+        if (rc == -1)
+            goto error;
+        if (!self->running)
+            return rc;
+        //  A peer that crashes never sets its closed flag; the socket
+        //  hangs up all the same
+        if (s_poll_set (self) == -1)
+            goto error;
+        *fd = self->pfd;
+    }
+    else {
+        struct epoll_event events [2];
+        const int n = epoll_wait (self->pfd, events, 2, 0);
+        for (int i = 0; i < n; i++) {
+            //  The peer sends nothing after setup, so any event on the
+            //  socket is a hang-up or an error
+            if (events [i].data.fd == self->fd)
+                goto error;
+            uint64_t v;
+            const ssize_t rc = read (self->efd, &v, sizeof v);
+            (void) rc;
+        }
+    }
+
+    if (s_run (self) == -1)
+        goto error;
+    return ZKERNEL_POLLIN | ZKERNEL_INPUT_DRAINED | ZKERNEL_OUTPUT_DRAINED;
+
+error:
+    s_send_session_closed (self);
+    *fd = -1;
+    return -1;
+}
+
+//  Exchange setup messages. Returns the poll flags to wait with, or -1
+//  on error; the session is running once both sides have the rings.
+
+static int
+s_setup (shm_session_t *self)
+{
+    if (self->side == 0) {
+        if (!self->setup_sent) {
+            const int fds [2] = { self->memfd, self->efd };
+            const int rc = s_send_setup (self, fds, 2);
+            if (rc == -1)
+                return errno == EAGAIN
+                    ? ZKERNEL_POLLOUT | ZKERNEL_OUTPUT_DRAINED: -1;
+            close (self->memfd);
+            self->memfd = -1;
+            self->setup_sent = true;
+        }
+        struct shm_setup setup;
+        int fds [2];
+        size_t nfds = 2;
+        if (s_recv_setup (self, &setup, fds, &nfds) == -1)
+            return errno == EAGAIN
+                ? ZKERNEL_POLLIN | ZKERNEL_INPUT_DRAINED: -1;
+        if (nfds != 1 || setup.ring_size != self->ring_size) {
+            for (size_t i = 0; i < nfds; i++)
+                close (fds [i]);
+            return -1;
+        }
+        self->peer_efd = fds [0];
+    }
+    else {
+        struct shm_setup setup;
+        int fds [2];
+        size_t nfds = 2;
+        if (s_recv_setup (self, &setup, fds, &nfds) == -1)
+            return errno == EAGAIN
+                ? ZKERNEL_POLLIN | ZKERNEL_INPUT_DRAINED: -1;
+        if (nfds != 2
+                || setup.ring_size < SHM_RING_MIN_SIZE
+                || setup.ring_size > SHM_RING_MAX_SIZE
+                || (setup.ring_size & (setup.ring_size - 1)) != 0) {
+            for (size_t i = 0; i < nfds; i++)
+                close (fds [i]);
+            return -1;
+        }
+        self->peer_efd = fds [1];
+        self->ring_size = setup.ring_size;
+        //  Only sealed memory is safe to map; it cannot shrink away
+        const int seals = fcntl (fds [0], F_GET_SEALS);
+        struct stat st;
+        if (seals == -1 || (seals & F_SEAL_SHRINK) == 0
+                || fstat (fds [0], &st) == -1
+                || (size_t) st.st_size < SHM_DATA_OFFSET + 2 * self->ring_size
+                || s_map (self, fds [0]) == -1) {
+            close (fds [0]);
+            return -1;
+        }
+        close (fds [0]);
+        if (self->header->magic != SHM_SESSION_MAGIC
+                || self->header->ring_size != self->ring_size)
+            return -1;
+        //  A small message on a fresh socket does not block
+        if (s_send_setup (self, &self->efd, 1) == -1)
+            return -1;
+    }
+
+    uint8_t *base = (uint8_t *) self->header;
+    shm_ring_t *rings [2] = {
+        shm_ring_new (
+            base + SHM_CONTROL_OFFSET,
+            base + SHM_DATA_OFFSET, self->ring_size),
+        shm_ring_new (
+            base + SHM_CONTROL_OFFSET + SHM_RING_CONTROL_SIZE,
+            base + SHM_DATA_OFFSET + self->ring_size, self->ring_size)
+    };
+    self->tx = rings [self->side];
+    self->rx = rings [1 - self->side];
+    if (self->tx == NULL || self->rx == NULL)
+        return -1;
+    self->running = true;
+    return 0;
+}
+
+static int
+s_poll_set (shm_session_t *self)
+{
+    self->pfd = epoll_create1 (EPOLL_CLOEXEC);
+    if (self->pfd == -1)
+        return -1;
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = self->efd };
+    if (epoll_ctl (self->pfd, EPOLL_CTL_ADD, self->efd, &ev) == -1)
+        return -1;
+    ev = (struct epoll_event) {
+        .events = EPOLLIN | EPOLLRDHUP,
+        .data.fd = self->fd
+    };
+    return epoll_ctl (self->pfd, EPOLL_CTL_ADD, self->fd, &ev);
+}
+
+static int
+s_map (shm_session_t *self, int memfd)
+{
+    const size_t map_size = SHM_DATA_OFFSET + 2 * self->ring_size;
+    void *ptr = mmap (
+        NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (ptr == MAP_FAILED)
+        return -1;
+    self->header = (struct shm_header *) ptr;
+    self->map_size = map_size;
+    return 0;
+}
+
+//  Move messages both ways until there is nothing left to do, then
+//  park. Parking and the final check for work are ordered by the swap,
+//  and the peer publishes before it looks whether we are parked, so
+//  one side or the other always notices.
+
+static int
+s_run (shm_session_t *self)
+{
+    int *parked = &self->header->parked [self->side];
+    while (true) {
+        if (atomic_int_get (&self->header->closed [1 - self->side]))
+            return -1;
+        const int rc = s_input (self);
+        if (rc == -1)
+            return -1;
+        if (s_output (self) == -1)
+            return -1;
+        if (rc == 1) {
+            //  Over budget; ring our own bell to come back after other
+            //  sources have had their turn
+            s_ring (self->efd);
+            return 0;
+        }
+        atomic_int_swap (parked, 1);
+        const int written = s_output (self);
+        if (written == -1)
+            return -1;
+        if (written == 0 && !shm_ring_readable (self->rx))
+            return 0;
+        atomic_int_set (parked, 0);
+    }
+}
+
+//  Copy records out of the ring and pass them to the owner as one
+//  batch. Returns 1 when the batch budget ran out, 0 when the ring is
+//  empty and -1 on error.
+
+static int
+s_input (shm_session_t *self)
+{
+    msg_t *head = NULL;
+    msg_t *tail = NULL;
+    uint32_t count = 0;
+    int rc = 0;
+
+    while (true) {
+        if (count == SHM_SESSION_READ_BATCH) {
+            rc = 1;
+            break;
+        }
+        uint32_t flags;
+        const void *data;
+        size_t size;
+        if (shm_ring_read (self->rx, &flags, &data, &size) == -1) {
+            if (errno != EAGAIN)
+                rc = -1;
+            break;
+        }
+        count++;
+        if (self->max_msg_size > 0 && size > self->max_msg_size) {
+            rc = -1;
+            break;
+        }
+        pdu_t *pdu = pdu_new_with_size (size);
+        if (pdu == NULL) {
+            rc = -1;
+            break;
+        }
+        memcpy (pdu->pdu_data, data, size);
+        pdu->flags = flags & PDU_MORE;
+        msg_t *msg = (msg_t *) pdu;
+        //  Parts of a multipart message are passed on together once
+        //  the last one arrives
+        if ((pdu->flags & PDU_MORE) != 0 || self->inbound) {
+            if (self->inbound == NULL) {
+                self->inbound = multipart_new ();
+                if (self->inbound == NULL) {
+                    pdu_destroy (&pdu);
+                    rc = -1;
+                    break;
+                }
+            }
+            const bool more = (pdu->flags & PDU_MORE) != 0;
+            multipart_append (self->inbound, pdu);
+            if (multipart_too_large (self->inbound, self->max_msg_size)) {
+                rc = -1;
+                break;
+            }
+            if (more)
+                continue;
+            self->inbound->io_object = &self->base;
+            msg = (msg_t *) self->inbound;
+            self->inbound = NULL;
+        }
+        else
+            pdu->io_object = &self->base;
+        msg->next = NULL;
+        if (tail)
+            tail->next = msg;
+        else
+            head = msg;
+        tail = msg;
+    }
+
+    if (count > 0) {
+        shm_ring_release (self->rx);
+        s_signal (self);
+    }
+    if (rc == -1) {
+        while (head) {
+            msg_t *msg = head;
+            head = head->next;
+            msg_destroy (&msg);
+        }
+    }
+    else
+    if (head)
+        socket_send_batch (self->owner, head, tail);
+    return rc;
+}
+
+//  Copy queued messages into the ring, as far as there is room.
+//  Returns the number of records written, or -1 on error.
+
+static int
+s_output (shm_session_t *self)
+{
+    int written = 0;
+    while (true) {
+        if (self->pending == NULL) {
+            if (self->outbound) {
+                self->pending = multipart_pop (self->outbound);
+                if (self->outbound->parts == 0)
+                    multipart_destroy (&self->outbound);
+            }
+            else
+            if (!msg_queue_is_empty (self->msg_queue)) {
+                msg_t *msg = msg_queue_dequeue (self->msg_queue);
+                self->queued--;
+                if (!s_fits (self, msg)) {
+                    //  Would never fit; drop it rather than the session
+                    msg_destroy (&msg);
+                    continue;
+                }
+                if (msg->msg_type == ZKERNEL_MSG_TYPE_MULTIPART) {
+                    self->outbound = (multipart_t *) msg;
+                    continue;
+                }
+                self->pending = (pdu_t *) msg;
+            }
+            if (self->pending == NULL)
+                break;
+        }
+        const int rc = shm_ring_write (
+            self->tx, self->pending->flags & PDU_MORE,
+            self->pending->pdu_data, self->pending->pdu_size);
+        if (rc == -1) {
+            if (errno == EAGAIN)
+                break;
+            return -1;
+        }
+        pdu_destroy (&self->pending);
+        written++;
+    }
+    if (written > 0) {
+        shm_ring_publish (self->tx);
+        s_signal (self);
+    }
+    return written;
+}
+
+//  Whether every frame of the message fits in a ring record. Checked
+//  before any frame is written, so a message goes whole or not at all.
+
+static bool
+s_fits (shm_session_t *self, msg_t *msg)
+{
+    const size_t max_size = shm_ring_max_size (self->tx);
+    if (msg->msg_type == ZKERNEL_MSG_TYPE_PDU)
+        return ((pdu_t *) msg)->pdu_size <= max_size;
+    for (pdu_t *part = ((multipart_t *) msg)->head;
+            part; part = (pdu_t *) part->base.next)
+        if (part->pdu_size > max_size)
+            return false;
+    return true;
+}
+
+//  Wake the peer if it is parked. Only the side that flips the flag
+//  writes the eventfd.
+
+static void
+s_signal (shm_session_t *self)
+{
+    int *parked = &self->header->parked [1 - self->side];
+    if (atomic_int_get (parked) == 1
+            && atomic_int_cas (parked, 1, 0) == 1)
+        s_ring (self->peer_efd);
+}
+
+//  Fails only when the counter would overflow, and then the eventfd
+//  is readable anyway
+
+static void
+s_ring (int efd)
+{
+    const uint64_t v = 1;
+    const ssize_t rc = write (efd, &v, sizeof v);
+    (void) rc;
+}
+
+static int
+s_send_setup (shm_session_t *self, const int *fds, size_t nfds)
+{
+    assert (nfds <= 2);
+
+    struct shm_setup setup = {
+        .magic = SHM_SESSION_MAGIC,
+        .version = SHM_SESSION_VERSION,
+        .ring_size = self->ring_size
+    };
+    struct iovec iov = { .iov_base = &setup, .iov_len = sizeof setup };
+    union {
+        struct cmsghdr align;
+        char buf [CMSG_SPACE (2 * sizeof (int))];
+    } control;
+    memset (&control, 0, sizeof control);
+    struct msghdr msghdr = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = CMSG_SPACE (nfds * sizeof (int))
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msghdr);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN (nfds * sizeof (int));
+    memcpy (CMSG_DATA (cmsg), fds, nfds * sizeof (int));
+
+    const ssize_t rc = sendmsg (self->fd, &msghdr, MSG_NOSIGNAL);
+    if (rc == -1)
+        return -1;
+    if (rc != sizeof setup) {
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+//  Receive setup message. On entry nfds holds the room in fds, on
+//  return the number of descriptors received.
+
+static int
+s_recv_setup (
+    shm_session_t *self, struct shm_setup *setup, int *fds, size_t *nfds)
+{
+    struct iovec iov = { .iov_base = setup, .iov_len = sizeof *setup };
+    union {
+        struct cmsghdr align;
+        char buf [CMSG_SPACE (2 * sizeof (int))];
+    } control;
+    struct msghdr msghdr = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof control.buf
+    };
+    const ssize_t rc = recvmsg (self->fd, &msghdr, MSG_CMSG_CLOEXEC);
+    if (rc == -1)
+        return -1;
+
+    size_t received = 0;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msghdr); cmsg;
+            cmsg = CMSG_NXTHDR (&msghdr, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        const size_t n = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+        for (size_t i = 0; i < n; i++) {
+            int fd;
+            memcpy (&fd, CMSG_DATA (cmsg) + i * sizeof (int), sizeof fd);
+            if (received < *nfds)
+                fds [received++] = fd;
+            else
+                close (fd);
+        }
+    }
+    *nfds = received;
+
+    if (rc != sizeof *setup
+            || (msghdr.msg_flags & MSG_CTRUNC) != 0
+            || setup->magic != SHM_SESSION_MAGIC
+            || setup->version != SHM_SESSION_VERSION) {
+        for (size_t i = 0; i < received; i++)
+            close (fds [i]);
+        *nfds = 0;
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+static int
+s_io_message (io_object_t *self_, msg_t *msg)
+{
+    shm_session_t *self = (shm_session_t *) self_;
+    assert (self);
+
+    if (msg->msg_type != ZKERNEL_MSG_TYPE_PDU
+            && msg->msg_type != ZKERNEL_MSG_TYPE_MULTIPART)
+        msg_destroy (&msg);
+    else
+    if (self->sndhwm > 0 && self->queued >= self->sndhwm)
+        //  Ring full and queue at the high-water mark
+        msg_destroy (&msg);
+    else {
+        msg_queue_enqueue (self->msg_queue, msg);
+        self->queued++;
+    }
+
+    if (!self->running)
+        return self->side == 0 && !self->setup_sent
+            ? ZKERNEL_POLLOUT: ZKERNEL_POLLIN;
+
+    //  Straight into the ring; if it is full, the peer wakes us when it
+    //  makes room, as we are parked
+    if (s_output (self) == -1)
+        //  Let the next event find the error
+        s_ring (self->efd);
+    return ZKERNEL_POLLIN;
+}
+
+static struct io_object_ops io_ops = {
+    .init  = s_io_init,
+    .destroy = s_destroy,
+    .event = s_io_event,
+    .message = s_io_message,
+};
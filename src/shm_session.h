@@ -0,0 +1,32 @@
+//  Shared memory session class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#ifndef __SHM_SESSION_H_INCLUDED__
+#define __SHM_SESSION_H_INCLUDED__
+
+#include <stddef.h>
+
+#include "socket.h"
+
+//  Exchanges messages with a process on the same host through a pair
+//  of rings in shared memory, one per direction. The connecting side
+//  creates the memory and passes it over a Unix domain socket, along
+//  with an eventfd; the accepting side answers with an eventfd of its
+//  own. Either side signals the other's eventfd only when that side
+//  is parked. Messages with a frame larger than half a ring are
+//  dropped when they reach the front of the queue.
+typedef struct shm_session shm_session_t;
+
+//  Take over connected Unix domain socket in non-blocking mode. The
+//  connecting side passes the size of each ring, a power of two; the
+//  accepting side passes 0 and takes the size from the peer.
+shm_session_t *
+    shm_session_new (int fd, size_t ring_size, socket_t *owner);
+
+void
+    shm_session_destroy (shm_session_t **self_p);
+
+#endif
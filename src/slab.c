@@ -0,0 +1,241 @@
+//  Slab allocator
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "atomic.h"
+#include "slab.h"
+
+//  Size classes are powers of two from 32 to 4096 bytes. Each slab
+//  of SLAB_SIZE bytes is carved into blocks of one class.
+
+#define MIN_CLASS_BITS  5
+#define CLASSES         8
+#define MAX_BLOCK_SIZE  (1 << (MIN_CLASS_BITS + CLASSES - 1))
+#define SLAB_SIZE       (64 * 1024)
+
+//  Header preceding every block
+struct block {
+    //  Owning cache, NULL for oversized blocks
+    struct slab_cache *cache;
+    size_t size_class;
+};
+
+//  Free blocks are linked through their payload
+struct free_block {
+    struct free_block *next;
+};
+
+struct slab_cache {
+    struct free_block *free_list [CLASSES];
+    //  Blocks freed by other threads, pushed lock-free
+    struct free_block *remote;
+    slab_stats_t stats;
+    //  Link in the list of all caches
+    struct slab_cache *next;
+    //  Link in the list of caches whose thread has exited
+    struct slab_cache *next_orphan;
+};
+
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+static pthread_key_t s_key;
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct slab_cache *s_caches;
+static struct slab_cache *s_orphans;
+
+static __thread struct slab_cache *s_cache;
+
+static struct slab_cache *
+    s_cache_get ();
+
+static void
+    s_cache_release (void *udata);
+
+static void
+    s_init ();
+
+static int
+    s_refill (struct slab_cache *cache, size_t size_class);
+
+static struct block *
+s_block (void *ptr)
+{
+    return (struct block *) ptr - 1;
+}
+
+void *
+slab_alloc (size_t size)
+{
+    struct slab_cache *cache = s_cache_get ();
+    if (cache == NULL)
+        return NULL;
+
+    if (size > MAX_BLOCK_SIZE - sizeof (struct block)) {
+        if (size > SIZE_MAX - sizeof (struct block))
+            return NULL;
+        struct block *block =
+            (struct block *) malloc (sizeof *block + size);
+        if (block == NULL)
+            return NULL;
+        *block = (struct block) { .cache = NULL, .size_class = CLASSES };
+        cache->stats.allocs++;
+        cache->stats.mallocs++;
+        return block + 1;
+    }
+
+    size_t size_class = 0;
+    while (((size_t) 1 << (MIN_CLASS_BITS + size_class))
+            < sizeof (struct block) + size)
+        size_class++;
+
+    if (cache->free_list [size_class] == NULL)
+        if (s_refill (cache, size_class) == -1)
+            return NULL;
+
+    struct free_block *free_block = cache->free_list [size_class];
+    cache->free_list [size_class] = free_block->next;
+    struct block *block = (struct block *) free_block;
+    *block = (struct block) { .cache = cache, .size_class = size_class };
+    cache->stats.allocs++;
+    return block + 1;
+}
+
+void
+slab_free (void *ptr)
+{
+    if (ptr == NULL)
+        return;
+
+    struct block *block = s_block (ptr);
+    struct slab_cache *owner = block->cache;
+    struct slab_cache *cache = s_cache_get ();
+
+    if (cache)
+        cache->stats.frees++;
+
+    if (owner == NULL)
+        free (block);
+    else
+    if (owner == cache) {
+        struct free_block *free_block = (struct free_block *) block;
+        free_block->next = cache->free_list [block->size_class];
+        cache->free_list [block->size_class] = free_block;
+    }
+    else {
+        //  Size class is kept in the header while on the remote stack
+        struct free_block *free_block = (struct free_block *) ptr;
+        void *head = atomic_ptr_get ((void **) &owner->remote);
+        free_block->next = (struct free_block *) head;
+        void *prev = atomic_ptr_cas ((void **) &owner->remote, head, block);
+        while (prev != head) {
+            head = prev;
+            free_block->next = (struct free_block *) head;
+            prev = atomic_ptr_cas ((void **) &owner->remote, head, block);
+        }
+        if (cache)
+            cache->stats.remote_frees++;
+    }
+}
+
+void
+slab_stats (slab_stats_t *stats)
+{
+    assert (stats);
+    *stats = (slab_stats_t) { .allocs = 0 };
+    pthread_mutex_lock (&s_mutex);
+    for (struct slab_cache *cache = s_caches; cache; cache = cache->next) {
+        stats->allocs += cache->stats.allocs;
+        stats->frees += cache->stats.frees;
+        stats->remote_frees += cache->stats.remote_frees;
+        stats->mallocs += cache->stats.mallocs;
+    }
+    pthread_mutex_unlock (&s_mutex);
+}
+
+//  Take blocks returned by other threads, or carve a new slab
+
+static int
+s_refill (struct slab_cache *cache, size_t size_class)
+{
+    struct block *block =
+        (struct block *) atomic_ptr_swap ((void **) &cache->remote, NULL);
+    while (block) {
+        struct free_block *free_block = (struct free_block *) (block + 1);
+        struct block *next = (struct block *) free_block->next;
+        free_block = (struct free_block *) block;
+        free_block->next = cache->free_list [block->size_class];
+        cache->free_list [block->size_class] = free_block;
+        block = next;
+    }
+    if (cache->free_list [size_class])
+        return 0;
+
+    char *slab = (char *) malloc (SLAB_SIZE);
+    if (slab == NULL)
+        return -1;
+    cache->stats.mallocs++;
+    const size_t block_size = (size_t) 1 << (MIN_CLASS_BITS + size_class);
+    for (size_t offset = 0; offset + block_size <= SLAB_SIZE;
+            offset += block_size) {
+        struct free_block *free_block = (struct free_block *) (slab + offset);
+        free_block->next = cache->free_list [size_class];
+        cache->free_list [size_class] = free_block;
+    }
+    return 0;
+}
+
+//  Return the calling thread's cache, adopting one left behind by
+//  an exited thread when possible. Caches are never freed, as blocks
+//  they own may still be in use.
+
+static struct slab_cache *
+s_cache_get ()
+{
+    if (s_cache)
+        return s_cache;
+
+    pthread_once (&s_once, s_init);
+    pthread_mutex_lock (&s_mutex);
+    struct slab_cache *cache = s_orphans;
+    if (cache)
+        s_orphans = cache->next_orphan;
+    else {
+        cache = (struct slab_cache *) malloc (sizeof *cache);
+        if (cache) {
+            *cache = (struct slab_cache) { .next = s_caches };
+            s_caches = cache;
+        }
+    }
+    pthread_mutex_unlock (&s_mutex);
+
+    if (cache) {
+        pthread_setspecific (s_key, cache);
+        s_cache = cache;
+    }
+    return cache;
+}
+
+static void
+s_cache_release (void *udata)
+{
+    struct slab_cache *cache = (struct slab_cache *) udata;
+    s_cache = NULL;
+    pthread_mutex_lock (&s_mutex);
+    cache->next_orphan = s_orphans;
+    s_orphans = cache;
+    pthread_mutex_unlock (&s_mutex);
+}
+
+static void
+s_init ()
+{
+    const int rc = pthread_key_create (&s_key, s_cache_release);
+    assert (rc == 0);
+}
@@ -0,0 +1,40 @@
+//  Slab allocator
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#ifndef __SLAB_H_INCLUDED__
+#define __SLAB_H_INCLUDED__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//  Size-classed allocator with a free list cache per thread. Blocks
+//  freed by another thread are handed back to the owning cache
+//  through a lock-free stack. Requests above the largest size class
+//  go to malloc.
+
+struct slab_stats {
+    uint64_t allocs;
+    uint64_t frees;
+    //  Frees of blocks owned by another thread
+    uint64_t remote_frees;
+    //  Calls into malloc, for new slabs and oversized blocks
+    uint64_t mallocs;
+};
+
+typedef struct slab_stats slab_stats_t;
+
+void *
+    slab_alloc (size_t size);
+
+void
+    slab_free (void *ptr);
+
+//  Sum of counters over all threads. Counters are updated without
+//  synchronization, so the snapshot is approximate.
+void
+    slab_stats (slab_stats_t *stats);
+
+#endif
@@ -7,25 +7,29 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
-#include <unistd.h>
-#include <sys/eventfd.h>
 #include <assert.h>
 #include <errno.h>
 
 #include "dispatcher.h"
 #include "reactor.h"
+#include "reactor_group.h"
 #include "proxy.h"
 #include "io_object.h"
 #include "socket.h"
+#include "pdu.h"
+#include "inproc_pipe.h"
 #include "atomic.h"
 #include "msg.h"
+#include "mailbox.h"
+#include "clock.h"
+#include "socket_options.h"
 #include "zkernel.h"
 
 struct socket {
-    int ctrl_fd;
-    reactor_t *reactor;
+    reactor_group_t *reactors;
     proxy_t *proxy;
-    void *mbox;
+    socket_options_t *options;
+    mailbox_t *mbox;
     struct actor actor_ifc;
 };
 
@@ -48,13 +52,16 @@ static int
     s_enqueue_msg (void *self_, struct msg_t *msg);
 
 static msg_t *
-    s_wait_for_msgs (socket_t *self);
+    s_wait_for_msg (socket_t *self);
 
 static void
-    process_mbox (socket_t *self, msg_t *msg);
+    s_session (socket_t *self, msg_t *msg);
 
 static void
-    s_session (socket_t *self, msg_t *msg);
+    s_received (socket_t *self, msg_t *msg);
+
+static int
+    s_listen (socket_t *self, io_object_t *io_object, reactor_t *reactor);
 
 static io_descriptor_t *
 s_new_session ()
@@ -87,29 +94,26 @@ s_new_connector ()
 }
 
 socket_t *
-socket_new (dispatcher_t *dispatcher, reactor_t *reactor)
+socket_new (dispatcher_t *dispatcher, reactor_group_t *reactors)
 {
     socket_t *self = malloc (sizeof *self);
     if (!self)
         return NULL;
-    //  XXX EFD_CLOEXEC only since Linux 2.6.27
-    int ctrl_fd = eventfd (0, EFD_CLOEXEC);
-    if (ctrl_fd == -1) {
-        free (self);
-        return NULL;
-    }
     *self = (socket_t) {
-        .ctrl_fd = ctrl_fd,
-        .reactor = reactor,
+        .reactors = reactors,
+        .options = socket_options_new (),
+        .mbox = mailbox_new (),
         .actor_ifc = {
             .object = self,
             .ftab = { .send = s_enqueue_msg }
         }
     };
     self->proxy = proxy_new (
-        &self->actor_ifc, s_new_session, dispatcher, reactor);
-    if (self->proxy == NULL) {
-        close (self->ctrl_fd);
+        &self->actor_ifc, s_new_session, dispatcher, reactors);
+    if (self->proxy == NULL || self->options == NULL || self->mbox == NULL) {
+        proxy_destroy (&self->proxy);
+        socket_options_destroy (&self->options);
+        mailbox_destroy (&self->mbox);
         free (self);
         self = NULL;
     }
@@ -122,8 +126,9 @@ socket_destroy (socket_t **self_p)
     assert (self_p);
     if (*self_p) {
         socket_t *self = *self_p;
-        close (self->ctrl_fd);
         proxy_destroy (&self->proxy);
+        socket_options_destroy (&self->options);
+        mailbox_destroy (&self->mbox);
         free (self);
         *self_p = NULL;
     }
@@ -135,6 +140,13 @@ socket_proxy (socket_t *self)
     return self->proxy;
 }
 
+socket_options_t *
+socket_get_options (socket_t *self)
+{
+    assert (self);
+    return self->options;
+}
+
 static void
 s_session_closed (socket_t *self, msg_t *msg)
 {
@@ -151,6 +163,8 @@ process_msg (socket_t *self, msg_t **msg_p)
 
     switch (msg->msg_type) {
     case ZKERNEL_MSG_TYPE_PDU:
+    case ZKERNEL_MSG_TYPE_MULTIPART:
+        s_received (self, msg);
         msg_destroy (&msg);
         break;
     case ZKERNEL_SESSION:
@@ -172,7 +186,23 @@ int
 socket_listen (socket_t *self, io_object_t *io_object)
 {
     assert (self);
+    return s_listen (
+        self, io_object, reactor_group_select (self->reactors, 0));
+}
+
+int
+socket_listen_on (socket_t *self, io_object_t *io_object, size_t reactor_index)
+{
+    assert (self);
+    if (reactor_index >= reactor_group_size (self->reactors))
+        return -1;
+    return s_listen (
+        self, io_object, reactor_group_reactor (self->reactors, reactor_index));
+}
 
+static int
+s_listen (socket_t *self, io_object_t *io_object, reactor_t *reactor)
+{
     msg_t *msg = msg_new (ZKERNEL_START_IO);
     if (!msg)
         return -1;
@@ -186,7 +216,7 @@ socket_listen (socket_t *self, io_object_t *io_object)
     msg->u.start_io.io_descriptor = &listener->base;
     msg->u.start_io.reply_to = self->actor_ifc;
 
-    reactor_send (self->reactor, msg);
+    reactor_send (reactor, msg);
 
     return 0;
 }
@@ -209,7 +239,7 @@ socket_connect (socket_t *self, io_object_t *io_object)
     msg->u.start_io.io_descriptor = &connector->base;
     msg->u.start_io.reply_to = self->actor_ifc;
 
-    reactor_send (self->reactor, msg);
+    reactor_send (reactor_group_select (self->reactors, 0), msg);
 
     return 0;
 }
@@ -221,22 +251,25 @@ socket_send_msg (socket_t *self, msg_t *msg)
     s_enqueue_msg (self, msg);
 }
 
-static void
-process_mbox (socket_t *self, msg_t *msg)
+void
+socket_send_batch (socket_t *self, msg_t *head, msg_t *tail)
 {
-    //  Transform LIFO to FIFO
-    msg_t *prev = NULL;
-    while (msg->next) {
-        msg_t *next = msg->next;
-        msg->next = prev;
-        prev = msg;
-        msg = next;
-    }
-    msg->next = prev;
-    while (msg) {
-        msg_t *next = msg->next;
+    assert (self);
+    mailbox_push_batch (self->mbox, head, tail);
+}
+
+msg_t *
+socket_recv (socket_t *self)
+{
+    assert (self);
+    while (true) {
+        msg_t *msg = s_wait_for_msg (self);
+        if (msg->msg_type == ZKERNEL_MSG_TYPE_PDU
+                || msg->msg_type == ZKERNEL_MSG_TYPE_MULTIPART) {
+            s_received (self, msg);
+            return msg;
+        }
         process_msg (self, &msg);
-        msg = next;
     }
 }
 
@@ -244,9 +277,9 @@ void
 socket_noop (socket_t *self)
 {
     assert (self);
-    void *ptr = atomic_ptr_swap (&self->mbox, NULL);
-    if (ptr)
-        process_mbox (self, (msg_t *) ptr);
+    msg_t *msg;
+    while ((msg = mailbox_pop (self->mbox)))
+        process_msg (self, &msg);
 }
 
 static int
@@ -254,48 +287,47 @@ s_enqueue_msg (void *self_, struct msg_t *msg)
 {
     socket_t *self = (socket_t *) self_;
     assert (self);
-    void *tail = atomic_ptr_get (&self->mbox);
-    atomic_ptr_set ((void **) &msg->next, tail == self? NULL: tail);
-    void *prev = atomic_ptr_cas (&self->mbox, tail, msg);
-    while (prev != tail) {
-        tail = prev;
-        atomic_ptr_set ((void **) &msg->next, tail);
-        prev = atomic_ptr_cas (&self->mbox, tail, msg);
-    }
-    if (prev == self) {
-        uint64_t v = 1;
-        const int rc = write (self->ctrl_fd, &v, sizeof v);
-        assert (rc == sizeof v);
-    }
+    mailbox_push (self->mbox, msg);
     return 0;
 }
 
 static msg_t *
-s_wait_for_msgs (socket_t *self)
+s_wait_for_msg (socket_t *self)
+{
+    msg_t *msg = mailbox_pop (self->mbox);
+    const uint32_t spin_budget =
+        socket_options_spin_budget (self->options);
+    if (msg == NULL && spin_budget > 0) {
+        //  Producers do not signal the eventfd while the consumer is
+        //  awake, so spinning saves them a syscall as well as saving
+        //  us the wakeup.
+        const uint64_t deadline = clock_now_ns () + spin_budget * 1000ull;
+        while (mailbox_is_empty (self->mbox) && clock_now_ns () < deadline)
+            atomic_pause ();
+        msg = mailbox_pop (self->mbox);
+    }
+    if (msg == NULL)
+        msg = mailbox_wait (self->mbox);
+    return msg;
+}
+
+//  Give credit back to the pipe the message came through
+
+static void
+s_received (socket_t *self, msg_t *msg)
 {
-    void *ptr = atomic_ptr_swap (&self->mbox, NULL);
-    if (ptr == NULL) {
-        ptr = atomic_ptr_cas (&self->mbox, NULL, self);
-        if (ptr == NULL) {
-            uint64_t buf;
-            int rc = read (self->ctrl_fd, &buf, sizeof buf);
-            while (rc == -1) {
-                assert (errno == EINTR);
-                rc = read (self->ctrl_fd, &buf, sizeof buf);
-            }
-            assert (rc == sizeof buf);
-            ptr = atomic_ptr_swap (&self->mbox, NULL);
-            assert (ptr);
+    if (msg->msg_type == ZKERNEL_MSG_TYPE_PDU) {
+        pdu_t *pdu = (pdu_t *) msg;
+        if (pdu->pipe) {
+            inproc_pipe_consumed (pdu->pipe, self);
+            pdu->pipe = NULL;
         }
     }
-    return (struct msg_t *) ptr;
 }
 
 static void
 s_session (socket_t *self, msg_t *msg)
 {
-    printf ("new session: %p\n", msg->u.session.session);
-
     struct session *session =
         (struct session *) msg->u.session.io_descriptor;
     session->io_object = msg->u.session.session;
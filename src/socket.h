@@ -9,8 +9,10 @@
 
 #include "msg.h"
 #include "reactor.h"
+#include "reactor_group.h"
 #include "io_object.h"
 #include "protocol_engine.h"
+#include "socket_options.h"
 
 typedef struct socket socket_t;
 
@@ -18,7 +20,7 @@ struct dispatcher;
 struct proxy;
 
 socket_t *
-    socket_new (struct dispatcher *dispatcher, reactor_t *reactor);
+    socket_new (struct dispatcher *dispatcher, reactor_group_t *reactors);
 
 void
     socket_destroy (socket_t **self_p);
@@ -26,20 +28,41 @@ void
 struct proxy *
     socket_proxy (socket_t *self);
 
+//  Options are read by I/O threads when they start sessions; set
+//  them before the socket listens or connects.
+socket_options_t *
+    socket_get_options (socket_t *self);
+
 int
     socket_listen (socket_t *self, io_object_t *listener);
 
+//  Start listener on the reactor with given index in the socket's
+//  reactor group
+int
+    socket_listen_on (
+        socket_t *self, io_object_t *listener, size_t reactor_index);
+
 int
     socket_connect (socket_t *self, io_object_t *connector);
 
 void
     socket_send_msg (socket_t *self, msg_t *msg);
 
+//  Send messages head .. tail, linked through next, in one atomic
+//  operation
+void
+    socket_send_batch (socket_t *self, msg_t *head, msg_t *tail);
+
 /*
 int
     socket_send (socket_t *self, const char *data, size_t size);
     */
 
+//  Block until a PDU or multipart message arrives, handling control
+//  messages meanwhile. The caller owns the message.
+msg_t *
+    socket_recv (socket_t *self);
+
 void
     socket_noop (socket_t *self);
 
@@ -12,6 +12,20 @@
 
 struct socket_options {
     char *socket_id;
+    uint32_t spin_budget;
+    int busy_poll;
+    uint32_t cork_budget;
+    uint32_t cork_timeout;
+    size_t buffer_size;
+    size_t buffer_min_size;
+    size_t buffer_max_size;
+    size_t copy_threshold;
+    size_t max_msg_size;
+    int backlog;
+    bool reuseport;
+    bool fast_accept;
+    uint32_t sndhwm;
+    size_t shm_ring_size;
 };
 
 socket_options_t *
@@ -19,7 +33,13 @@ socket_options_new ()
 {
     socket_options_t *self = malloc (sizeof *self);
     if (self) {
-        *self = (socket_options_t) {};
+        *self = (socket_options_t) {
+            .buffer_size = 4096,
+            .buffer_min_size = 4096,
+            .buffer_max_size = 256 * 1024,
+            .backlog = 32,
+            .sndhwm = 1000,
+        };
     }
 
     return self;
@@ -65,3 +85,204 @@ socket_options_set_socket_id (socket_options_t *self, const char *socket_id)
 
     return 0;
 }
+
+uint32_t
+socket_options_spin_budget (socket_options_t *self)
+{
+    assert (self);
+    return self->spin_budget;
+}
+
+void
+socket_options_set_spin_budget (socket_options_t *self, uint32_t spin_budget)
+{
+    assert (self);
+    self->spin_budget = spin_budget;
+}
+
+int
+socket_options_busy_poll (socket_options_t *self)
+{
+    assert (self);
+    return self->busy_poll;
+}
+
+void
+socket_options_set_busy_poll (socket_options_t *self, int busy_poll)
+{
+    assert (self);
+    self->busy_poll = busy_poll;
+}
+
+uint32_t
+socket_options_cork_budget (socket_options_t *self)
+{
+    assert (self);
+    return self->cork_budget;
+}
+
+void
+socket_options_set_cork_budget (socket_options_t *self, uint32_t cork_budget)
+{
+    assert (self);
+    self->cork_budget = cork_budget;
+}
+
+uint32_t
+socket_options_cork_timeout (socket_options_t *self)
+{
+    assert (self);
+    return self->cork_timeout;
+}
+
+void
+socket_options_set_cork_timeout (socket_options_t *self, uint32_t cork_timeout)
+{
+    assert (self);
+    self->cork_timeout = cork_timeout;
+}
+
+size_t
+socket_options_buffer_size (socket_options_t *self)
+{
+    assert (self);
+    return self->buffer_size;
+}
+
+void
+socket_options_set_buffer_size (socket_options_t *self, size_t buffer_size)
+{
+    assert (self);
+    self->buffer_size = buffer_size;
+}
+
+size_t
+socket_options_buffer_min_size (socket_options_t *self)
+{
+    assert (self);
+    return self->buffer_min_size;
+}
+
+void
+socket_options_set_buffer_min_size (
+    socket_options_t *self, size_t buffer_min_size)
+{
+    assert (self);
+    self->buffer_min_size = buffer_min_size;
+}
+
+size_t
+socket_options_buffer_max_size (socket_options_t *self)
+{
+    assert (self);
+    return self->buffer_max_size;
+}
+
+void
+socket_options_set_buffer_max_size (
+    socket_options_t *self, size_t buffer_max_size)
+{
+    assert (self);
+    self->buffer_max_size = buffer_max_size;
+}
+
+size_t
+socket_options_copy_threshold (socket_options_t *self)
+{
+    assert (self);
+    return self->copy_threshold;
+}
+
+void
+socket_options_set_copy_threshold (
+    socket_options_t *self, size_t copy_threshold)
+{
+    assert (self);
+    self->copy_threshold = copy_threshold;
+}
+
+size_t
+socket_options_max_msg_size (socket_options_t *self)
+{
+    assert (self);
+    return self->max_msg_size;
+}
+
+void
+socket_options_set_max_msg_size (
+    socket_options_t *self, size_t max_msg_size)
+{
+    assert (self);
+    self->max_msg_size = max_msg_size;
+}
+
+int
+socket_options_backlog (socket_options_t *self)
+{
+    assert (self);
+    return self->backlog;
+}
+
+void
+socket_options_set_backlog (socket_options_t *self, int backlog)
+{
+    assert (self);
+    self->backlog = backlog;
+}
+
+bool
+socket_options_reuseport (socket_options_t *self)
+{
+    assert (self);
+    return self->reuseport;
+}
+
+void
+socket_options_set_reuseport (socket_options_t *self, bool reuseport)
+{
+    assert (self);
+    self->reuseport = reuseport;
+}
+
+bool
+socket_options_fast_accept (socket_options_t *self)
+{
+    assert (self);
+    return self->fast_accept;
+}
+
+void
+socket_options_set_fast_accept (socket_options_t *self, bool fast_accept)
+{
+    assert (self);
+    self->fast_accept = fast_accept;
+}
+
+uint32_t
+socket_options_sndhwm (socket_options_t *self)
+{
+    assert (self);
+    return self->sndhwm;
+}
+
+void
+socket_options_set_sndhwm (socket_options_t *self, uint32_t sndhwm)
+{
+    assert (self);
+    self->sndhwm = sndhwm;
+}
+
+size_t
+socket_options_shm_ring_size (socket_options_t *self)
+{
+    assert (self);
+    return self->shm_ring_size;
+}
+
+void
+socket_options_set_shm_ring_size (
+    socket_options_t *self, size_t shm_ring_size)
+{
+    assert (self);
+    self->shm_ring_size = shm_ring_size;
+}
@@ -7,8 +7,15 @@
 #ifndef __SOCKET_OPTIONS_H_INCLUDED__
 #define __SOCKET_OPTIONS_H_INCLUDED__
 
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
 typedef struct socket_options socket_options_t;
 
+socket_options_t *
+    socket_options_new ();
+
 void
     socket_options_destroy (socket_options_t **self_p);
 
@@ -19,4 +26,136 @@ int
     socket_options_set_socket_id (
         socket_options_t *self, const char *socket_id);
 
+//  Time in us the socket spins on its mailbox before it blocks
+uint32_t
+    socket_options_spin_budget (socket_options_t *self);
+
+void
+    socket_options_set_spin_budget (
+        socket_options_t *self, uint32_t spin_budget);
+
+//  SO_BUSY_POLL value in us applied to session sockets, 0 leaves
+//  the system default
+int
+    socket_options_busy_poll (socket_options_t *self);
+
+void
+    socket_options_set_busy_poll (socket_options_t *self, int busy_poll);
+
+//  Sessions hold output back until this many bytes are queued, the
+//  encoder is full or the cork timeout expires. 0 disables corking.
+uint32_t
+    socket_options_cork_budget (socket_options_t *self);
+
+void
+    socket_options_set_cork_budget (
+        socket_options_t *self, uint32_t cork_budget);
+
+//  Time in us corked output may wait for more messages; with 0,
+//  output is flushed as soon as the send queue runs empty
+uint32_t
+    socket_options_cork_timeout (socket_options_t *self);
+
+void
+    socket_options_set_cork_timeout (
+        socket_options_t *self, uint32_t cork_timeout);
+
+//  Size sessions start their send and receive buffers with
+size_t
+    socket_options_buffer_size (socket_options_t *self);
+
+void
+    socket_options_set_buffer_size (
+        socket_options_t *self, size_t buffer_size);
+
+//  Limits for adaptive receive buffer sizing. Buffers grow while reads
+//  keep filling them and shrink back while the session sees little
+//  traffic. Send buffers keep their starting size.
+size_t
+    socket_options_buffer_min_size (socket_options_t *self);
+
+void
+    socket_options_set_buffer_min_size (
+        socket_options_t *self, size_t buffer_min_size);
+
+size_t
+    socket_options_buffer_max_size (socket_options_t *self);
+
+void
+    socket_options_set_buffer_max_size (
+        socket_options_t *self, size_t buffer_max_size);
+
+//  Frame bodies larger than this are received into and sent from
+//  the message directly instead of being copied through the session
+//  buffers. 0 tunes the receive threshold from observed message sizes
+//  and sends from the message above 256 bytes. Protocol engines that
+//  hand out iovecs always send from the message.
+size_t
+    socket_options_copy_threshold (socket_options_t *self);
+
+void
+    socket_options_set_copy_threshold (
+        socket_options_t *self, size_t copy_threshold);
+
+//  Sessions fail when the peer sends a frame longer than this many
+//  bytes, before the frame is allocated, or a multipart message
+//  longer than this in total. 0 means no limit.
+size_t
+    socket_options_max_msg_size (socket_options_t *self);
+
+void
+    socket_options_set_max_msg_size (
+        socket_options_t *self, size_t max_msg_size);
+
+//  Length of the listen queue of TCP listeners
+int
+    socket_options_backlog (socket_options_t *self);
+
+void
+    socket_options_set_backlog (socket_options_t *self, int backlog);
+
+//  Listen with one SO_REUSEPORT socket per reactor; the kernel spreads
+//  incoming connections across them and each session stays on the
+//  reactor that accepted it
+bool
+    socket_options_reuseport (socket_options_t *self);
+
+void
+    socket_options_set_reuseport (socket_options_t *self, bool reuseport);
+
+//  Listeners register accepted sessions on their own reactor and
+//  tell the socket afterwards, instead of going through the
+//  dispatcher and the placement policy
+bool
+    socket_options_fast_accept (socket_options_t *self);
+
+void
+    socket_options_set_fast_accept (
+        socket_options_t *self, bool fast_accept);
+
+//  PDUs a socket may have in flight on an in-process pipe before
+//  sending fails, and messages a shared memory session holds back
+//  while its ring is full before it drops new ones. 0 means no
+//  limit. Read when the pipe or session is created.
+uint32_t
+    socket_options_sndhwm (socket_options_t *self);
+
+void
+    socket_options_set_sndhwm (socket_options_t *self, uint32_t sndhwm);
+
+//  IPC connections set up rings of this size in shared memory, one
+//  per direction, and carry messages through them instead of running
+//  ZMTP over the socket. 0 disables this. Must be a power of two of
+//  at least 4KiB, and set on both ends; listeners take the size from
+//  the connecting peer. This is a mode of the endpoint, not something
+//  negotiated: a listener with rings drops peers that speak ZMTP, and
+//  a connector with rings is dropped by a listener without them.
+//  Listeners read it when bound, connectors on every connection.
+size_t
+    socket_options_shm_ring_size (socket_options_t *self);
+
+void
+    socket_options_set_shm_ring_size (
+        socket_options_t *self, size_t shm_ring_size);
+
 #endif
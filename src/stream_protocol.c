@@ -180,12 +180,14 @@ s_write (protocol_engine_t *base, iobuf_t *iobuf, protocol_engine_info_t *info)
 
     pdu_t *pdu = self->decoder_pdu;
     if (pdu == NULL) {
-        pdu = pdu_new ();
+        //  Deliver the stream in chunks of inline buffer size
+        pdu = pdu_new_with_size (PDU_INLINE_SIZE);
         if (pdu == NULL)
             return -1;
+        pdu->pdu_size = 0;
         self->decoder_pdu = pdu;
         self->write_buffer = pdu->pdu_data;
-        self->write_buffer_size = pdu->pdu_size;
+        self->write_buffer_size = PDU_INLINE_SIZE;
     }
 
     const size_t n = iobuf_read (iobuf,
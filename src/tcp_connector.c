@@ -162,11 +162,11 @@ io_event (io_object_t *self_, uint32_t flags, int *fd, uint32_t *timer_interval)
     }
     else
     if (self->err == EINPROGRESS)
-        return 3;
+        return 3 | ZKERNEL_INPUT_DRAINED | ZKERNEL_OUTPUT_DRAINED;
     else {
         close (self->fd);
         *fd = self->fd = -1;
-        *timer_interval = 2500;
+        *timer_interval = 2500000;
         return 0;
     }
 }
@@ -180,7 +180,7 @@ io_timeout (io_object_t *self_, int *fd, uint32_t *timer_interval)
     //  Create socket
     const int s = socket (AF_INET, SOCK_STREAM, 0);
     if (s == -1) {
-        *timer_interval = 1000;
+        *timer_interval = 1000000;
         return 0;
     }
     //  Set non-blocking mode
@@ -202,7 +202,7 @@ io_timeout (io_object_t *self_, int *fd, uint32_t *timer_interval)
         const int rc = close (s);
         assert (rc);
         self->err == errno;
-        *timer_interval = 2500;
+        *timer_interval = 2500000;
         return 0;
     }
 }
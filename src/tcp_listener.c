@@ -4,7 +4,10 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
 
+#define _GNU_SOURCE
+
 #include <assert.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -18,12 +21,23 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include "proxy.h"
+#include "reactor.h"
+#include "reactor_group.h"
 #include "socket.h"
+#include "socket_options.h"
 #include "zkernel.h"
 
+//  Time in us to stop accepting after running out of descriptors or
+//  memory; connections wait in the backlog meanwhile
+#define TCP_LISTENER_BACKOFF_INTERVAL 100000
+
 struct tcp_listener {
     io_object_t base;
     int fd;
+    //  Bound with SO_REUSEPORT; sessions stay on this reactor
+    bool reuseport;
+    //  Register sessions here, see socket_options.h
+    bool fast_accept;
     protocol_engine_constructor_t *protocol_engine_constructor;
     socket_t *owner;
 };
@@ -34,11 +48,34 @@ static int
 static int
     io_event (io_object_t *self_, uint32_t flags, int *fd, uint32_t *timer_interval);
 
+static int
+    io_timeout (io_object_t *self_, int *fd, uint32_t *timer_interval);
+
 static struct io_object_ops ops = {
     .init  = io_init,
-    .event = io_event
+    .event = io_event,
+    .timeout = io_timeout
 };
 
+//  Hash peer's IP address, so that connections from the same host
+//  can be kept together by the placement policy.
+
+static uint32_t
+s_peer_hash (struct sockaddr_storage *addr, socklen_t addr_len)
+{
+    if (addr->ss_family == AF_INET) {
+        const struct sockaddr_in *sin = (struct sockaddr_in *) addr;
+        return reactor_group_hash (&sin->sin_addr, sizeof sin->sin_addr);
+    }
+    else
+    if (addr->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) addr;
+        return reactor_group_hash (&sin6->sin6_addr, sizeof sin6->sin6_addr);
+    }
+    else
+        return reactor_group_hash (addr, addr_len);
+}
+
 tcp_listener_t *
 tcp_listener_new (protocol_engine_constructor_t *protocol_engine_constructor, socket_t *owner)
 {
@@ -74,13 +111,23 @@ tcp_listener_bind (tcp_listener_t *self, unsigned short port)
     assert (self);
     if (self->fd != -1)
         return -1;
-    const int fd = socket (AF_INET, SOCK_STREAM, 0);
+    socket_options_t *options = socket_get_options (self->owner);
+    const int fd =
+        socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (fd == -1)
         return -1;
     const int on = 1;
     //  Allow port reuse
     rc = setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
     assert (rc == 0);
+    //  Let each reactor bind its own socket to the port
+    if (socket_options_reuseport (options)) {
+        rc = setsockopt (fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on);
+        if (rc == -1) {
+            close (fd);
+            return -1;
+        }
+    }
 
     struct sockaddr_in server_addr = {
         .sin_family = AF_INET,
@@ -92,13 +139,15 @@ tcp_listener_bind (tcp_listener_t *self, unsigned short port)
         close (fd);
         return -1;
     }
-    rc = listen (fd, 32);
+    rc = listen (fd, socket_options_backlog (options));
     if (rc == -1) {
         close (fd);
         return -1;
     }
 
     self->fd = fd;
+    self->reuseport = socket_options_reuseport (options);
+    self->fast_accept = socket_options_fast_accept (options);
     return 0;
 }
 
@@ -108,12 +157,7 @@ io_init (io_object_t *self_, io_descriptor_t *io_descriptor, int *fd, uint32_t *
     tcp_listener_t *self = (tcp_listener_t *) self_;
     assert (self);
 
-    //  Set non-blocking mode
-    const int flags = fcntl (self->fd, F_GETFL, 0);
-    assert (flags != -1);
-    int rc = fcntl (self->fd, F_SETFL, flags | O_NONBLOCK);
-    assert (rc == 0);
-
+    //  The socket was created non-blocking
     *fd = self->fd;
     return 3;
 }
@@ -131,16 +175,30 @@ io_event (io_object_t *self_, uint32_t flags, int *fd, uint32_t *timer_interval)
     }
 
     while (1) {
-        const int rc = accept (self->fd, NULL, NULL);
+        struct sockaddr_storage peer_addr;
+        socklen_t peer_addr_len = sizeof peer_addr;
+        const int rc = accept4 (
+            self->fd, (struct sockaddr *) &peer_addr, &peer_addr_len,
+            SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (rc == -1) {
-            assert (errno == EAGAIN);
+            //  Connection reset while queued
+            if (errno == ECONNABORTED || errno == EINTR)
+                continue;
+            //  The pending connection stays queued, so polling would
+            //  report it again right away
+            if (errno == EMFILE || errno == ENFILE
+                    || errno == ENOBUFS || errno == ENOMEM) {
+                *timer_interval = TCP_LISTENER_BACKOFF_INTERVAL;
+                return 0;
+            }
             break;
         }
-        printf ("connection accepted\n");
 
         protocol_engine_t *protocol_engine = self->protocol_engine_constructor ();
-        if (protocol_engine == NULL)
+        if (protocol_engine == NULL) {
+            close (rc);
             continue;
+        }
 
         tcp_session_t *session =
             tcp_session_new (rc, protocol_engine, self->owner);
@@ -148,13 +206,35 @@ io_event (io_object_t *self_, uint32_t flags, int *fd, uint32_t *timer_interval)
             close (rc);
             continue;
         }
+        const uint32_t peer_hash = s_peer_hash (&peer_addr, peer_addr_len);
+        if (self->fast_accept) {
+            if (proxy_start_session (
+                    socket_proxy (self->owner), self->base.reactor,
+                    (io_object_t *) session, peer_hash) == -1)
+                tcp_session_destroy (&session);
+            continue;
+        }
         msg_t *msg = msg_new (ZKERNEL_SESSION);
         if (msg == NULL)
             tcp_session_destroy (&session);
         else {
             msg->u.session.session = (io_object_t *) session;
+            msg->u.session.peer_hash = peer_hash;
+            if (self->reuseport)
+                msg->u.session.reactor = self->base.reactor;
             proxy_send (socket_proxy (self->owner), msg);
         }
     }
+    return 1 | 2 | ZKERNEL_INPUT_DRAINED;
+}
+
+//  Back-off is over; resume polling for connections
+
+static int
+io_timeout (io_object_t *self_, int *fd, uint32_t *timer_interval)
+{
+    tcp_listener_t *self = (tcp_listener_t *) self_;
+    assert (self);
+
     return 1 | 2;
 }
@@ -4,12 +4,15 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
 
+#define _GNU_SOURCE
+
 #include <assert.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -18,20 +21,72 @@
 #include "tcp_session.h"
 #include "msg.h"
 #include "msg_queue.h"
+#include "multipart.h"
 #include "socket.h"
 #include "zkernel.h"
+#include "clock.h"
 #include "protocol_engine.h"
+#include "socket_options.h"
+
+//  Maximum number of iovec entries per sendmsg
+#define MAX_IOV 64
+
+//  Buffers double after this many reads in a row fill them and halve
+//  after this many drains in a row use less than a quarter of them
+#define GROW_AFTER      2
+#define SHRINK_AFTER    8
+
+//  Bounds for the tuned copy/zero-copy threshold
+#define COPY_THRESHOLD_MIN  256
+#define COPY_THRESHOLD_MAX  16384
+
+//  Usage of one session buffer, for adaptive sizing
+struct iobuf_usage {
+    //  Size of the buffer to borrow next
+    size_t size;
+    //  Most bytes held at once since the last drain
+    size_t peak;
+    //  Consecutive reads that filled the buffer
+    uint32_t full;
+    //  Consecutive drains that used little of the buffer
+    uint32_t idle;
+    //  Moving average of message sizes in this direction
+    size_t msg_size;
+};
 
 struct tcp_session {
     io_object_t base;
     int fd;
     io_descriptor_t *io_descriptor;
     msg_queue_t *msg_queue;
+    //  Multipart message being received
+    multipart_t *inbound;
+    //  Parts of the multipart message being sent
+    multipart_t *outbound;
     protocol_engine_t *protocol_engine;
     protocol_engine_info_t peinfo;
+    //  Borrowed from the reactor's pool while data is in flight
     iobuf_t *sendbuf;
     iobuf_t *recvbuf;
+    //  Frames go out through iovecs, so the send buffer carries little
+    //  more than handshake output and keeps its starting size
+    size_t sendbuf_size;
+    struct iobuf_usage recv_usage;
+    //  Buffer size limits and copy threshold, see socket_options.h
+    size_t buffer_min_size;
+    size_t buffer_max_size;
+    size_t copy_threshold;
+    //  Longest frame or message accepted from the peer, see
+    //  socket_options.h
+    size_t max_msg_size;
     socket_t *owner;
+    //  Corking policy, see socket_options.h
+    uint32_t cork_budget;
+    uint32_t cork_timeout;
+    //  Bytes encoded since output last went idle
+    size_t corked_bytes;
+    //  Time in us when corked output must go out
+    uint64_t cork_deadline;
 };
 
 static int
@@ -40,6 +95,34 @@ static int
 static int
     s_output (tcp_session_t *self);
 
+static bool
+    s_flush_due (tcp_session_t *self);
+
+static int
+    s_io_mask (tcp_session_t *self, int drained, uint32_t *timer_interval);
+
+static void
+    s_usage_fill (struct iobuf_usage *usage, size_t bytes, size_t size);
+
+static void
+    s_usage_msg (struct iobuf_usage *usage, size_t msg_size);
+
+static void
+    s_grow (
+        tcp_session_t *self, iobuf_t **iobuf_p, struct iobuf_usage *usage);
+
+static void
+    s_shrink (tcp_session_t *self, struct iobuf_usage *usage);
+
+static int
+    s_acquire (tcp_session_t *self, iobuf_t **iobuf_p, size_t size);
+
+static void
+    s_release (tcp_session_t *self, iobuf_t **iobuf_p);
+
+static size_t
+    s_copy_threshold (tcp_session_t *self, struct iobuf_usage *usage);
+
 static struct io_object_ops io_ops;
 
 tcp_session_t *
@@ -47,21 +130,36 @@ tcp_session_new (int fd, protocol_engine_t *protocol_engine, socket_t *owner)
 {
     tcp_session_t *self = (tcp_session_t *) malloc (sizeof *self);
     if (self) {
-        const size_t buffer_size = 4096;
+        socket_options_t *options = socket_get_options (owner);
+        size_t buffer_min_size = socket_options_buffer_min_size (options);
+        size_t buffer_max_size = socket_options_buffer_max_size (options);
+        if (buffer_max_size < buffer_min_size)
+            buffer_max_size = buffer_min_size;
+        size_t buffer_size = socket_options_buffer_size (options);
+        if (buffer_size < buffer_min_size)
+            buffer_size = buffer_min_size;
+        else
+        if (buffer_size > buffer_max_size)
+            buffer_size = buffer_max_size;
         *self = (tcp_session_t) {
             .base = (io_object_t) { .ops = io_ops },
             .fd = fd,
             .msg_queue = msg_queue_new (),
             .protocol_engine = protocol_engine,
-            .sendbuf = iobuf_new (buffer_size),
-            .recvbuf = iobuf_new (buffer_size),
+            .sendbuf_size = buffer_size,
+            .recv_usage.size = buffer_size,
+            .buffer_min_size = buffer_min_size,
+            .buffer_max_size = buffer_max_size,
+            .copy_threshold = socket_options_copy_threshold (options),
+            .max_msg_size = socket_options_max_msg_size (options),
             .owner = owner
         };
         if (protocol_engine_init (protocol_engine, &self->peinfo) == -1)
             goto error;
-        if (self->msg_queue == NULL)
+        if (protocol_engine_set_max_msg_size (
+                protocol_engine, self->max_msg_size) == -1)
             goto error;
-        if (self->sendbuf == NULL || self->recvbuf == NULL)
+        if (self->msg_queue == NULL)
             goto error;
     }
     return self;
@@ -72,10 +170,6 @@ error:
         msg_queue_destroy (&self->msg_queue);
     if (self->protocol_engine)
         protocol_engine_destroy (&self->protocol_engine);
-    if (self->sendbuf)
-        iobuf_destroy (&self->sendbuf);
-    if (self->recvbuf)
-        iobuf_destroy (&self->recvbuf);
     free (self);
 
     return NULL;
@@ -89,7 +183,11 @@ tcp_session_destroy (tcp_session_t **self_p)
         tcp_session_t *self = *self_p;
         close (self->fd);
         msg_queue_destroy (&self->msg_queue);
+        multipart_destroy (&self->inbound);
+        multipart_destroy (&self->outbound);
         protocol_engine_destroy (&self->protocol_engine);
+        //  Buffers go back to the pool when they run empty or the
+        //  connection fails, so normally there are none left here
         iobuf_destroy (&self->sendbuf);
         iobuf_destroy (&self->recvbuf);
         free (self);
@@ -118,13 +216,22 @@ s_io_init (io_object_t *self_, io_descriptor_t *io_descriptor, int *fd, uint32_t
     tcp_session_t *self = (tcp_session_t *) self_;
     assert (self);
 
-    //  Set non-blocking mode
-    const int flags = fcntl (self->fd, F_GETFL, 0);
-    assert (flags != -1);
-    int rc = fcntl (self->fd, F_SETFL, flags | O_NONBLOCK);
-    assert (rc == 0);
+    //  Listeners accept sockets in non-blocking mode already
     self->io_descriptor = io_descriptor;
 
+    socket_options_t *options = socket_get_options (self->owner);
+    self->cork_budget = socket_options_cork_budget (options);
+    self->cork_timeout = socket_options_cork_timeout (options);
+
+    const int busy_poll = socket_options_busy_poll (options);
+    if (busy_poll > 0) {
+        //  Best effort; raising it above the system default needs
+        //  CAP_NET_ADMIN.
+        setsockopt (
+            self->fd, SOL_SOCKET, SO_BUSY_POLL,
+            &busy_poll, sizeof busy_poll);
+    }
+
     *fd = self->fd;
     return ZKERNEL_POLLIN | ZKERNEL_POLLOUT;
 }
@@ -139,31 +246,105 @@ s_io_event (io_object_t *self_, uint32_t io_flags, int *fd, uint32_t *timer_inte
     if ((io_flags & ZKERNEL_IO_ERROR) != 0)
         goto error;
 
+    //  Readiness consumed down to EAGAIN
+    int drained = 0;
+
+    //  Batch of decoded messages for the owner
+    msg_t *head = NULL;
+    msg_t *tail = NULL;
+
     while (1) {
         if ((io_flags & ZKERNEL_INPUT_READY) != 0) {
-            if (s_input (self) == -1)
+            const int rc = s_input (self);
+            if (rc == -1)
                 goto error;
+            if (rc == 1) {
+                drained |= ZKERNEL_INPUT_DRAINED;
+                s_shrink (self, &self->recv_usage);
+            }
             if ((peinfo->flags & ZKERNEL_WRITE_OK) != 0)
                 io_flags &= ~ZKERNEL_INPUT_READY;
         }
 
+        //  Frames decoded from this read go to the owner as one batch
+        head = tail = NULL;
         while ((peinfo->flags & ZKERNEL_DECODER_READY) != 0) {
             pdu_t *pdu = protocol_engine_decode (self->protocol_engine, peinfo);
             if (pdu == NULL)
-                goto error;
-            pdu->io_object = self_;
-            socket_send_msg (self->owner, (msg_t *) pdu);
+                goto decode_error;
+            s_usage_msg (&self->recv_usage, pdu->pdu_size);
+            msg_t *msg = (msg_t *) pdu;
+            //  Parts of a multipart message are passed on together
+            //  once the last one arrives
+            if ((pdu->flags & PDU_MORE) != 0 || self->inbound) {
+                if (self->inbound == NULL) {
+                    self->inbound = multipart_new ();
+                    if (self->inbound == NULL) {
+                        pdu_destroy (&pdu);
+                        goto decode_error;
+                    }
+                }
+                const bool more = (pdu->flags & PDU_MORE) != 0;
+                multipart_append (self->inbound, pdu);
+                if (multipart_too_large (self->inbound, self->max_msg_size))
+                    goto decode_error;
+                if (more)
+                    continue;
+                self->inbound->io_object = self_;
+                msg = (msg_t *) self->inbound;
+                self->inbound = NULL;
+            }
+            else
+                pdu->io_object = self_;
+            msg->next = NULL;
+            if (tail)
+                tail->next = msg;
+            else
+                head = msg;
+            tail = msg;
         }
 
-        while (!msg_queue_is_empty (self->msg_queue) && (peinfo->flags & ZKERNEL_ENCODER_READY) != 0) {
-            msg_t *msg = msg_queue_dequeue (self->msg_queue);
-            if (protocol_engine_encode (self->protocol_engine, (pdu_t *) msg, peinfo) == -1)
+        if (head)
+            socket_send_batch (self->owner, head, tail);
+
+        while ((peinfo->flags & ZKERNEL_ENCODER_READY) != 0) {
+            if (self->cork_budget > 0 && self->corked_bytes >= self->cork_budget)
+                break;
+            //  Parts of a multipart message go out back to back
+            pdu_t *pdu = NULL;
+            if (self->outbound) {
+                pdu = multipart_pop (self->outbound);
+                if (self->outbound->parts == 0)
+                    multipart_destroy (&self->outbound);
+            }
+            else
+            if (!msg_queue_is_empty (self->msg_queue)) {
+                msg_t *msg = msg_queue_dequeue (self->msg_queue);
+                if (msg->msg_type == ZKERNEL_MSG_TYPE_MULTIPART) {
+                    self->outbound = (multipart_t *) msg;
+                    continue;
+                }
+                pdu = (pdu_t *) msg;
+            }
+            if (pdu == NULL)
+                break;
+            if (self->corked_bytes == 0)
+                self->cork_deadline = clock_now_us () + self->cork_timeout;
+            self->corked_bytes += pdu->pdu_size;
+            if (protocol_engine_encode (self->protocol_engine, pdu, peinfo) == -1)
                 goto error;
         }
 
+        //  Keep output readiness for later while corked
+        if ((io_flags & ZKERNEL_OUTPUT_READY) != 0 && !s_flush_due (self))
+            io_flags &= ~ZKERNEL_OUTPUT_READY;
+
         if ((io_flags & ZKERNEL_OUTPUT_READY) != 0) {
-            if (s_output (self) == -1)
+            const int rc = s_output (self);
+            if (rc == -1)
                 goto error;
+            if (rc == 1)
+                drained |= ZKERNEL_OUTPUT_DRAINED;
             if ((peinfo->flags & ZKERNEL_READ_OK) != 0)
                 io_flags &= ~ZKERNEL_OUTPUT_READY;
         }
@@ -172,6 +353,9 @@ s_io_event (io_object_t *self_, uint32_t io_flags, int *fd, uint32_t *timer_inte
             const int rc = protocol_engine_next (&self->protocol_engine, peinfo);
             if (rc == -1)
                 goto error;
+            if (protocol_engine_set_max_msg_size (
+                    self->protocol_engine, self->max_msg_size) == -1)
+                goto error;
         }
 
         uint32_t mask = peinfo->flags;
@@ -179,46 +363,126 @@ s_io_event (io_object_t *self_, uint32_t io_flags, int *fd, uint32_t *timer_inte
             mask &= ~ZKERNEL_WRITE_OK;
         if ((io_flags & ZKERNEL_OUTPUT_READY) == 0)
             mask &= ~ZKERNEL_READ_OK;
+        //  An idle encoder stays ready; that alone is no work to do
+        if ((msg_queue_is_empty (self->msg_queue) && self->outbound == NULL)
+                || (self->cork_budget > 0
+                    && self->corked_bytes >= self->cork_budget))
+            mask &= ~ZKERNEL_ENCODER_READY;
 
         if ((peinfo->flags & mask) == 0)
             break;
     }
 
-    int io_mask = 0;
-    if ((peinfo->flags & ZKERNEL_WRITE_OK) != 0)
-        io_mask |= ZKERNEL_POLLIN;
-    if ((peinfo->flags & ZKERNEL_READ_OK) != 0 || iobuf_available (self->sendbuf) > 0)
-        io_mask |= ZKERNEL_POLLOUT;
+    return s_io_mask (self, drained, timer_interval);
 
-    return io_mask;
+decode_error:
+    while (head) {
+        msg_t *msg = head;
+        head = head->next;
+        msg_destroy (&msg);
+    }
 
 error:
+    //  The connection is gone, and with it any data still buffered
+    iobuf_pool_put (self->base.iobuf_pool, &self->sendbuf);
+    iobuf_pool_put (self->base.iobuf_pool, &self->recvbuf);
     s_send_session_closed (self);
     *fd = -1;
     return -1;
 }
 
+static int
+s_io_timeout (io_object_t *self_, int *fd, uint32_t *timer_interval)
+{
+    tcp_session_t *self = (tcp_session_t *) self_;
+    assert (self);
+
+    //  Corked output is due now; ask for output readiness
+    return s_io_mask (self, 0, timer_interval);
+}
+
+//  Corked output goes out when the encoder is full, the byte budget
+//  is reached or the deadline has passed. Without a timeout it goes
+//  out as soon as the send queue is empty.
+
+static bool
+s_flush_due (tcp_session_t *self)
+{
+    if (self->cork_budget == 0 || self->corked_bytes == 0)
+        return true;
+    if ((self->peinfo.flags & ZKERNEL_ENCODER_READY) == 0)
+        return true;
+    if (self->corked_bytes >= self->cork_budget)
+        return true;
+    if (self->cork_timeout == 0)
+        return msg_queue_is_empty (self->msg_queue);
+    return clock_now_us () >= self->cork_deadline;
+}
+
+//  Return poll flags for the session. While output is corked, POLLOUT
+//  is left out and the timer fires at the cork deadline instead.
+
+static int
+s_io_mask (tcp_session_t *self, int drained, uint32_t *timer_interval)
+{
+    protocol_engine_info_t *peinfo = &self->peinfo;
+
+    //  Idle sessions hold no buffers
+    s_release (self, &self->sendbuf);
+    s_release (self, &self->recvbuf);
+
+    if ((peinfo->flags & ZKERNEL_READ_OK) == 0 && self->sendbuf == NULL)
+        self->corked_bytes = 0;
+
+    //  Queued messages are encoded on output readiness
+    const bool queued = (peinfo->flags & ZKERNEL_ENCODER_READY) != 0
+        && (self->outbound || !msg_queue_is_empty (self->msg_queue));
+
+    int io_mask = drained;
+    if ((peinfo->flags & ZKERNEL_WRITE_OK) != 0)
+        io_mask |= ZKERNEL_POLLIN;
+    if ((peinfo->flags & ZKERNEL_READ_OK) != 0 || self->sendbuf || queued) {
+        if (s_flush_due (self) || self->cork_timeout == 0)
+            io_mask |= ZKERNEL_POLLOUT;
+        else {
+            const uint64_t now = clock_now_us ();
+            *timer_interval = self->cork_deadline > now
+                ? (uint32_t) (self->cork_deadline - now): 1;
+        }
+    }
+
+    return io_mask;
+}
+
+//  Returns 1 when the socket has been read until EAGAIN, 0 when
+//  reading stopped for another reason and -1 on error.
+
 static int
 s_input (tcp_session_t *self)
 {
     protocol_engine_t *protocol_engine = self->protocol_engine;
     protocol_engine_info_t *peinfo = &self->peinfo;
-    iobuf_t *recvbuf = self->recvbuf;
+    const size_t copy_threshold =
+        s_copy_threshold (self, &self->recv_usage);
+    bool drained = false;
 
     while ((peinfo->flags & ZKERNEL_WRITE_OK) != 0) {
-        if (iobuf_available (recvbuf) > 0) {
-            if (protocol_engine_write (protocol_engine, recvbuf, peinfo) != 0)
-                return -1;
-        }
-        else {
-            if (peinfo->write_buffer_size > 256) {
+        const bool buffered =
+            self->recvbuf && iobuf_available (self->recvbuf) > 0;
+        if (!buffered) {
+            if (drained)
+                return 1;
+            if (peinfo->write_buffer_size > copy_threshold) {
                 assert (peinfo->write_buffer);
                 const ssize_t rc = recv (
                     self->fd, peinfo->write_buffer, peinfo->write_buffer_size, 0);
                 if (rc == 0)
                     return -1;
                 if (rc == -1) {
-                    if (errno == EINTR || errno == EAGAIN)
+                    if (errno == EAGAIN)
+                        return 1;
+                    else
+                    if (errno == EINTR)
                         return 0;
                     else
                         return -1;
@@ -226,88 +490,237 @@ s_input (tcp_session_t *self)
                 if (protocol_engine_write_advance (
                         protocol_engine, (size_t) rc, peinfo) != 0)
                     return -1;
+                continue;
             }
-            else {
-                iobuf_reset (recvbuf);
-                const ssize_t rc = iobuf_recv (recvbuf, self->fd);
-                if (rc == 0)
-                    return -1;
-                if (rc == -1) {
-                    if (errno == EINTR || errno == EAGAIN)
-                        return 0;
-                    else
-                        return -1;
-                }
-            }
+            s_grow (self, &self->recvbuf, &self->recv_usage);
+            if (s_acquire (self, &self->recvbuf, self->recv_usage.size) == -1)
+                return -1;
         }
+
+        //  Receive behind the bytes the engine has not taken yet; the
+        //  ring keeps the free space contiguous across the wrap
+        iobuf_t *recvbuf = self->recvbuf;
+        if (!drained && iobuf_space (recvbuf) > 0) {
+            const ssize_t rc = iobuf_recv (recvbuf, self->fd);
+            if (rc == 0)
+                return -1;
+            if (rc > 0)
+                s_usage_fill (&self->recv_usage,
+                    iobuf_available (recvbuf), recvbuf->size);
+            else
+            if (errno == EAGAIN)
+                drained = true;
+            else
+            if (errno != EINTR)
+                return -1;
+        }
+        if (iobuf_available (recvbuf) == 0)
+            return drained? 1: 0;
+        if (protocol_engine_write (protocol_engine, recvbuf, peinfo) != 0)
+            return -1;
     }
 
-    return 0;
+    return drained? 1: 0;
 }
 
+//  Returns 1 when the socket has been written until EAGAIN, 0 when
+//  writing stopped for another reason and -1 on error.
+
 static int
 s_output (tcp_session_t *self)
 {
     protocol_engine_t *protocol_engine = self->protocol_engine;
     protocol_engine_info_t *peinfo = &self->peinfo;
-    iobuf_t *sendbuf = self->sendbuf;
-
-    while (iobuf_available (sendbuf)) {
-        const ssize_t rc = iobuf_send (sendbuf, self->fd);
-        if (rc == -1) {
-            if (errno == EAGAIN || errno == EINTR)
-                return 0;
-            else
-                return -1;
-        }
-    }
-
-    while ((peinfo->flags & ZKERNEL_READ_OK) != 0) {
-        if (peinfo->read_buffer_size > 256) {
-            assert (peinfo->read_buffer);
-            const ssize_t rc = send (self->fd, peinfo->read_buffer, peinfo->read_buffer_size, 0);
-            if (rc == -1) {
-                if (errno == EAGAIN || errno == EINTR)
-                    return 0;
-                else
+    const size_t copy_threshold = self->copy_threshold > 0
+        ? self->copy_threshold: COPY_THRESHOLD_MIN;
+
+    while (true) {
+        const bool ready = (peinfo->flags & ZKERNEL_READ_OK) != 0;
+        const bool buffered =
+            self->sendbuf && iobuf_available (self->sendbuf) > 0;
+
+        //  Buffered bytes go out before anything sent from the engine
+        if (ready && !buffered) {
+            struct iovec iov [MAX_IOV];
+            const int iovcnt =
+                protocol_engine_iovec (protocol_engine, iov, MAX_IOV);
+            if (iovcnt > 0) {
+                //  Headers and bodies of queued frames in one call
+                const struct msghdr msghdr = {
+                    .msg_iov = iov,
+                    .msg_iovlen = (size_t) iovcnt
+                };
+                const ssize_t rc = sendmsg (self->fd, &msghdr, 0);
+                if (rc == -1) {
+                    if (errno == EAGAIN)
+                        return 1;
+                    else
+                    if (errno == EINTR)
+                        return 0;
+                    else
+                        return -1;
+                }
+                if (protocol_engine_read_advance (
+                        protocol_engine, (size_t) rc, peinfo) != 0)
                     return -1;
+                continue;
             }
-            if (protocol_engine_read_advance (
-                    protocol_engine, (size_t) rc, peinfo) != 0)
-                return -1;
-        }
-        else {
-            iobuf_reset (sendbuf);
-            const int rc = protocol_engine_read (protocol_engine, sendbuf, peinfo);
-            if (rc == -1)
-                return -1;
-            while (iobuf_available (sendbuf)) {
-                const ssize_t rc = iobuf_send (sendbuf, self->fd);
+            if (peinfo->read_buffer_size > copy_threshold) {
+                assert (peinfo->read_buffer);
+                const ssize_t rc = send (self->fd, peinfo->read_buffer, peinfo->read_buffer_size, 0);
                 if (rc == -1) {
-                    if (errno == EAGAIN || errno == EINTR)
+                    if (errno == EAGAIN)
+                        return 1;
+                    else
+                    if (errno == EINTR)
                         return 0;
                     else
                         return -1;
                 }
+                if (protocol_engine_read_advance (
+                        protocol_engine, (size_t) rc, peinfo) != 0)
+                    return -1;
+                continue;
             }
         }
+
+        //  Copy small frames in behind the bytes still waiting to go
+        //  out, so that a partial send does not hold back the rest
+        if (ready && peinfo->read_buffer_size <= copy_threshold) {
+            if (s_acquire (self, &self->sendbuf, self->sendbuf_size) == -1)
+                return -1;
+            iobuf_t *sendbuf = self->sendbuf;
+            if (iobuf_space (sendbuf) > 0
+                    && protocol_engine_read (
+                        protocol_engine, sendbuf, peinfo) == -1)
+                return -1;
+        }
+
+        if (self->sendbuf == NULL || iobuf_available (self->sendbuf) == 0)
+            break;
+        const ssize_t rc = iobuf_send (self->sendbuf, self->fd);
+        if (rc == -1) {
+            if (errno == EAGAIN)
+                return 1;
+            else
+            if (errno == EINTR)
+                return 0;
+            else
+                return -1;
+        }
     }
 
     return 0;
 }
 
+static int
+s_acquire (tcp_session_t *self, iobuf_t **iobuf_p, size_t size)
+{
+    if (*iobuf_p == NULL) {
+        assert (self->base.iobuf_pool);
+        *iobuf_p = iobuf_pool_get (self->base.iobuf_pool, size);
+        if (*iobuf_p == NULL)
+            return -1;
+    }
+    return 0;
+}
+
+//  Hand buffer back to the pool once it runs empty
+
+static void
+s_release (tcp_session_t *self, iobuf_t **iobuf_p)
+{
+    if (*iobuf_p && iobuf_available (*iobuf_p) == 0)
+        iobuf_pool_put (self->base.iobuf_pool, iobuf_p);
+}
+
+static void
+s_usage_fill (struct iobuf_usage *usage, size_t bytes, size_t size)
+{
+    if (bytes > usage->peak)
+        usage->peak = bytes;
+    if (bytes == size)
+        usage->full++;
+    else
+        usage->full = 0;
+}
+
+static void
+s_usage_msg (struct iobuf_usage *usage, size_t msg_size)
+{
+    usage->msg_size = usage->msg_size - usage->msg_size / 8 + msg_size / 8;
+}
+
+//  Called with the buffer empty, before it is filled again. A buffer
+//  smaller than the new size goes back to the pool.
+
+static void
+s_grow (tcp_session_t *self, iobuf_t **iobuf_p, struct iobuf_usage *usage)
+{
+    if (usage->full < GROW_AFTER || usage->size >= self->buffer_max_size)
+        return;
+    usage->full = 0;
+    usage->idle = 0;
+    usage->size = usage->size * 2 < self->buffer_max_size
+        ? usage->size * 2: self->buffer_max_size;
+    if (*iobuf_p && (*iobuf_p)->size < usage->size)
+        iobuf_pool_put (self->base.iobuf_pool, iobuf_p);
+}
+
+//  Called when the socket has been drained in this direction. The
+//  smaller size applies to the next buffer borrowed.
+
+static void
+s_shrink (tcp_session_t *self, struct iobuf_usage *usage)
+{
+    if (usage->peak < usage->size / 4)
+        usage->idle++;
+    else
+        usage->idle = 0;
+    usage->peak = 0;
+    usage->full = 0;
+    if (usage->idle < SHRINK_AFTER || usage->size <= self->buffer_min_size)
+        return;
+    usage->idle = 0;
+    usage->size = usage->size / 2 > self->buffer_min_size
+        ? usage->size / 2: self->buffer_min_size;
+}
+
+//  Bodies around the typical message size are copied through the
+//  buffer along with their neighbours, one syscall for many messages.
+//  Only bodies well above it are worth a syscall of their own.
+
+static size_t
+s_copy_threshold (tcp_session_t *self, struct iobuf_usage *usage)
+{
+    if (self->copy_threshold > 0)
+        return self->copy_threshold;
+    size_t threshold = usage->msg_size * 2;
+    if (threshold < COPY_THRESHOLD_MIN)
+        threshold = COPY_THRESHOLD_MIN;
+    else
+    if (threshold > COPY_THRESHOLD_MAX)
+        threshold = COPY_THRESHOLD_MAX;
+    if (threshold > usage->size / 2)
+        threshold = usage->size / 2;
+    return threshold;
+}
+
 static int
 s_io_message (io_object_t *self_, msg_t *msg)
 {
     tcp_session_t *self = (tcp_session_t *) self_;
     assert (self);
 
-    if (msg->msg_type == ZKERNEL_MSG_TYPE_PDU)
+    if (msg->msg_type == ZKERNEL_MSG_TYPE_PDU
+            || msg->msg_type == ZKERNEL_MSG_TYPE_MULTIPART)
         msg_queue_enqueue (self->msg_queue, msg);
     else
         msg_destroy (&msg);
 
-    return ZKERNEL_POLLIN | ZKERNEL_POLLOUT;
+    //  Output corked until a deadline has the timer armed already
+    uint32_t timer_interval = 0;
+    return s_io_mask (self, 0, &timer_interval);
 }
 
 static struct io_object_ops io_ops = {
@@ -315,4 +728,5 @@ static struct io_object_ops io_ops = {
     .destroy = s_destroy,
     .event = s_io_event,
     .message = s_io_message,
+    .timeout = s_io_timeout,
 };
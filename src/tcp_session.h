@@ -12,6 +12,8 @@
 
 typedef struct tcp_session tcp_session_t;
 
+//  Take over connected stream socket, TCP or Unix domain, which must
+//  be in non-blocking mode
 tcp_session_t *
     tcp_session_new (int fd, protocol_engine_t *protocol_engine, socket_t *owner);
 
@@ -0,0 +1,283 @@
+//  Hierarchical timer wheel class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "timer_wheel.h"
+
+//  Four levels of 256 slots cover 2^32 ticks. Level 0 holds timers
+//  expiring within the next 256 ticks, level n holds timers expiring
+//  within the next 256^(n+1) ticks and is cascaded into lower levels
+//  whenever the wheel crosses a 256^n tick boundary.
+
+#define LEVELS      4
+#define SLOT_BITS   8
+#define SLOTS       (1 << SLOT_BITS)
+#define SLOT_MASK   (SLOTS - 1)
+#define MAX_DELTA   ((UINT64_C (1) << (SLOT_BITS * LEVELS)) - 1)
+
+struct timer_wheel {
+    //  Next tick to be processed
+    uint64_t now;
+    //  Number of active timers
+    size_t count;
+    //  Bit set for every slot that may be non-empty
+    uint64_t bitmap [LEVELS][SLOTS / 64];
+    struct timer slots [LEVELS][SLOTS];
+    struct timer expired;
+};
+
+static void
+    s_place (timer_wheel_t *self, struct timer *timer);
+
+static void
+    s_cascade (timer_wheel_t *self, int level);
+
+static uint64_t
+    s_next_tick (timer_wheel_t *self);
+
+static int
+    s_find_slot (uint64_t *bitmap, struct timer *slots, unsigned start);
+
+extern inline bool
+timer_is_active (struct timer *timer);
+
+static void
+s_list_init (struct timer *head)
+{
+    head->prev = head->next = head;
+}
+
+static bool
+s_list_is_empty (struct timer *head)
+{
+    return head->next == head;
+}
+
+static void
+s_list_append (struct timer *head, struct timer *timer)
+{
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+static void
+s_list_remove (struct timer *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = NULL;
+}
+
+timer_wheel_t *
+timer_wheel_new (uint64_t now)
+{
+    timer_wheel_t *self = (timer_wheel_t *) malloc (sizeof *self);
+    if (self) {
+        *self = (timer_wheel_t) { .now = now };
+        for (int level = 0; level < LEVELS; level++)
+            for (int i = 0; i < SLOTS; i++)
+                s_list_init (&self->slots [level][i]);
+        s_list_init (&self->expired);
+    }
+    return self;
+}
+
+void
+timer_wheel_destroy (timer_wheel_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        timer_wheel_t *self = *self_p;
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+void
+timer_wheel_add (timer_wheel_t *self, struct timer *timer, uint64_t expires)
+{
+    assert (self);
+    assert (timer);
+
+    if (timer_is_active (timer))
+        s_list_remove (timer);
+    else
+        self->count++;
+    timer->expires = expires;
+    s_place (self, timer);
+}
+
+void
+timer_wheel_cancel (timer_wheel_t *self, struct timer *timer)
+{
+    assert (self);
+    assert (timer);
+
+    if (timer_is_active (timer)) {
+        s_list_remove (timer);
+        self->count--;
+    }
+}
+
+uint64_t
+timer_wheel_next_expiry (timer_wheel_t *self)
+{
+    assert (self);
+
+    if (!s_list_is_empty (&self->expired))
+        return 0;
+    if (self->count == 0)
+        return UINT64_MAX;
+    return s_next_tick (self);
+}
+
+struct timer *
+timer_wheel_expire (timer_wheel_t *self, uint64_t now)
+{
+    assert (self);
+
+    while (s_list_is_empty (&self->expired) && self->now <= now) {
+        const uint64_t tick = s_next_tick (self);
+        if (tick > now) {
+            self->now = now + 1;
+            break;
+        }
+        self->now = tick;
+        for (int level = 1; level < LEVELS; level++) {
+            if ((tick & ((UINT64_C (1) << (SLOT_BITS * level)) - 1)) != 0)
+                break;
+            s_cascade (self, level);
+        }
+        struct timer *slot = &self->slots [0][tick & SLOT_MASK];
+        while (!s_list_is_empty (slot)) {
+            struct timer *timer = slot->next;
+            s_list_remove (timer);
+            s_list_append (&self->expired, timer);
+        }
+        self->now = tick + 1;
+    }
+
+    if (s_list_is_empty (&self->expired))
+        return NULL;
+
+    struct timer *timer = self->expired.next;
+    s_list_remove (timer);
+    self->count--;
+    return timer;
+}
+
+static void
+s_place (timer_wheel_t *self, struct timer *timer)
+{
+    uint64_t expires = timer->expires;
+    if (expires < self->now)
+        expires = self->now;
+    uint64_t delta = expires - self->now;
+    if (delta > MAX_DELTA) {
+        //  Park it at the farthest slot; it is placed again when cascaded.
+        delta = MAX_DELTA;
+        expires = self->now + delta;
+    }
+
+    int level = 0;
+    while ((delta >> (SLOT_BITS * (level + 1))) != 0)
+        level++;
+    const unsigned index =
+        (unsigned) (expires >> (SLOT_BITS * level)) & SLOT_MASK;
+
+    s_list_append (&self->slots [level][index], timer);
+    self->bitmap [level][index / 64] |= UINT64_C (1) << (index % 64);
+}
+
+//  Move timers from the current slot at given level to lower levels.
+
+static void
+s_cascade (timer_wheel_t *self, int level)
+{
+    const unsigned index =
+        (unsigned) (self->now >> (SLOT_BITS * level)) & SLOT_MASK;
+    struct timer *slot = &self->slots [level][index];
+
+    //  Detach the slot first, timers may land in it again.
+    struct timer list;
+    s_list_init (&list);
+    if (!s_list_is_empty (slot)) {
+        list.next = slot->next;
+        list.prev = slot->prev;
+        list.next->prev = &list;
+        list.prev->next = &list;
+        s_list_init (slot);
+    }
+    self->bitmap [level][index / 64] &= ~(UINT64_C (1) << (index % 64));
+
+    while (!s_list_is_empty (&list)) {
+        struct timer *timer = list.next;
+        s_list_remove (timer);
+        s_place (self, timer);
+    }
+}
+
+//  Return the first tick at which the wheel has work to do: either a
+//  non-empty level 0 slot or a cascade of a non-empty upper slot.
+
+static uint64_t
+s_next_tick (timer_wheel_t *self)
+{
+    uint64_t next_tick = UINT64_MAX;
+
+    const int d = s_find_slot (
+        self->bitmap [0], self->slots [0], self->now & SLOT_MASK);
+    if (d != -1)
+        next_tick = self->now + d;
+
+    for (int level = 1; level < LEVELS; level++) {
+        const unsigned shift = SLOT_BITS * level;
+        //  First slot boundary not yet processed at this level
+        const uint64_t base =
+            (self->now + (UINT64_C (1) << shift) - 1) >> shift;
+        const int d = s_find_slot (
+            self->bitmap [level], self->slots [level], base & SLOT_MASK);
+        if (d != -1) {
+            const uint64_t tick = (base + d) << shift;
+            if (tick < next_tick)
+                next_tick = tick;
+        }
+    }
+
+    return next_tick;
+}
+
+//  Return distance from start to the first non-empty slot, or -1.
+//  Clears bits of slots found empty on the way.
+
+static int
+s_find_slot (uint64_t *bitmap, struct timer *slots, unsigned start)
+{
+    unsigned d = 0;
+    while (d < SLOTS) {
+        const unsigned index = (start + d) & SLOT_MASK;
+        const uint64_t word = bitmap [index / 64] >> (index % 64);
+        if (word == 0) {
+            d += 64 - index % 64;
+            continue;
+        }
+        d += (unsigned) __builtin_ctzll (word);
+        if (d >= SLOTS)
+            break;
+        const unsigned slot = (start + d) & SLOT_MASK;
+        if (!s_list_is_empty (&slots [slot]))
+            return (int) d;
+        bitmap [slot / 64] &= ~(UINT64_C (1) << (slot % 64));
+        d++;
+    }
+    return -1;
+}
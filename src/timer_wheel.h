@@ -0,0 +1,53 @@
+//  Hierarchical timer wheel class
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
+
+#ifndef __TIMER_WHEEL_H_INCLUDED__
+#define __TIMER_WHEEL_H_INCLUDED__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//  Timer handle. Embed it in the object owning the timer; the
+//  wheel links it into its slots, so arming and cancelling never
+//  allocate.
+struct timer {
+    struct timer *prev;
+    struct timer *next;
+    uint64_t expires;
+};
+
+typedef struct timer_wheel timer_wheel_t;
+
+timer_wheel_t *
+    timer_wheel_new (uint64_t now);
+
+void
+    timer_wheel_destroy (timer_wheel_t **self_p);
+
+//  Arm timer to expire at given tick. Re-arms timer if already active.
+void
+    timer_wheel_add (timer_wheel_t *self, struct timer *timer, uint64_t expires);
+
+void
+    timer_wheel_cancel (timer_wheel_t *self, struct timer *timer);
+
+//  Return earliest tick at which an expired timer may become available,
+//  or UINT64_MAX when no timer is armed.
+uint64_t
+    timer_wheel_next_expiry (timer_wheel_t *self);
+
+//  Return next timer expired at or before given tick, or NULL.
+//  The returned timer is no longer active.
+struct timer *
+    timer_wheel_expire (timer_wheel_t *self, uint64_t now);
+
+inline bool
+timer_is_active (struct timer *timer)
+{
+    return timer->next != NULL;
+}
+
+#endif
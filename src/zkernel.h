@@ -8,10 +8,11 @@
 //  Flags
 #define ZKERNEL_POLLIN          1
 #define ZKERNEL_POLLOUT         2
+//  Descriptor was read or written until EAGAIN
+#define ZKERNEL_INPUT_DRAINED   4
+#define ZKERNEL_OUTPUT_DRAINED  8
 
 //  Command ids
-#define ZKERNEL_KILL            1
-
 #define ZKERNEL_SESSION         1
 #define ZKERNEL_START_IO        2
 #define ZKERNEL_START_IO_ACK    3
@@ -20,9 +21,11 @@
 #define ZKERNEL_STOP_IO_ACK     6
 #define ZKERNEL_SESSION_CLOSED  7
 #define ZKERNEL_SESSION_ERROR   8
+#define ZKERNEL_KILL            9
 
 //  Frame ID
 #define ZKERNEL_MSG_TYPE_PDU    32
+#define ZKERNEL_MSG_TYPE_MULTIPART  33
 
 #define ZKERNEL_INPUT_READY     0x01
 #define ZKERNEL_OUTPUT_READY    0x02
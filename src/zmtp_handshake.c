@@ -32,8 +32,11 @@ typedef struct state state_t;
 struct zmtp_handshake {
     protocol_engine_t base;
     state_t state;
-    iobuf_t *sendbuf;
-    iobuf_t *recvbuf;
+    iobuf_t sendbuf;
+    iobuf_t recvbuf;
+    //  Room for a ZMTP v3 greeting each way
+    uint8_t sendbuf_data [64];
+    uint8_t recvbuf_data [64];
     char *socket_id;
     protocol_engine_t *next_stage;
 };
@@ -58,16 +61,11 @@ zmtp_handshake_new ()
         *self = (zmtp_handshake_t) {
             .base.ops = ops,
             .state.write = receive_signature_a,
-            .sendbuf = iobuf_new (zmtp_v3_greeting_size),
-            .recvbuf = iobuf_new (zmtp_v3_greeting_size),
         };
-
-        if (self->sendbuf == NULL || self->recvbuf == NULL) {
-            iobuf_destroy (&self->sendbuf);
-            iobuf_destroy (&self->recvbuf);
-            free (self);
-            self = NULL;
-        }
+        iobuf_init (
+            &self->sendbuf, self->sendbuf_data, sizeof self->sendbuf_data);
+        iobuf_init (
+            &self->recvbuf, self->recvbuf_data, sizeof self->recvbuf_data);
     }
 
     return self;
@@ -90,8 +88,8 @@ s_init (protocol_engine_t *base, protocol_engine_info_t *info)
 
     uint8_t signature [] = { 0xff, 0, 0, 0, 0, 0, 0, 0, 1, 0x7f };
     put_uint64 (signature + 1, socket_id_len + 1);
-    iobuf_write (self->sendbuf, signature, sizeof signature);
-    assert (iobuf_available (self->sendbuf) == sizeof signature);
+    iobuf_write (&self->sendbuf, signature, sizeof signature);
+    assert (iobuf_available (&self->sendbuf) == sizeof signature);
 
     *info = (protocol_engine_info_t) {
         .flags = ZKERNEL_READ_OK | ZKERNEL_WRITE_OK,
@@ -106,9 +104,9 @@ s_read (protocol_engine_t *base, iobuf_t *iobuf, protocol_engine_info_t *info)
     zmtp_handshake_t *self = (zmtp_handshake_t *) base;
     assert (self);
 
-    iobuf_copy_all (iobuf, self->sendbuf);
+    iobuf_copy_all (iobuf, &self->sendbuf);
     unsigned int flags = 0;
-    if (iobuf_available (self->sendbuf) > 0) {
+    if (iobuf_available (&self->sendbuf) > 0) {
         flags |= ZKERNEL_READ_OK;
         if (self->state.write != NULL)
             flags |= ZKERNEL_WRITE_OK;
@@ -134,7 +132,7 @@ s_write (protocol_engine_t *base, iobuf_t *iobuf, protocol_engine_info_t *info)
 
     self->state = self->state.write (self, iobuf);
     unsigned int flags = 0;
-    if (iobuf_available (self->sendbuf) > 0) {
+    if (iobuf_available (&self->sendbuf) > 0) {
         flags |= ZKERNEL_READ_OK;
         if (self->state.write != NULL)
             flags |= ZKERNEL_WRITE_OK;
@@ -177,8 +175,6 @@ s_next (protocol_engine_t **base_p, protocol_engine_info_t *info)
     assert (base_p);
     if (*base_p) {
         zmtp_handshake_t *self = (zmtp_handshake_t *) *base_p;
-        iobuf_destroy (&self->sendbuf);
-        iobuf_destroy (&self->recvbuf);
         free (self->socket_id);
         *base_p = self->next_stage;
         free (self);
@@ -191,8 +187,6 @@ s_destroy (protocol_engine_t **base_p)
     assert (base_p);
     if (*base_p) {
         zmtp_handshake_t *self = (zmtp_handshake_t *) *base_p;
-        iobuf_destroy (&self->sendbuf);
-        iobuf_destroy (&self->recvbuf);
         free (self->socket_id);
         *base_p = NULL;
         free (self);
@@ -202,15 +196,15 @@ s_destroy (protocol_engine_t **base_p)
 static state_t
 receive_signature_a (zmtp_handshake_t *self, iobuf_t *iobuf)
 {
-    iobuf_copy (self->recvbuf, iobuf, 1);
-    if (iobuf_available (self->recvbuf) < 1)
+    iobuf_copy (&self->recvbuf, iobuf, 1);
+    if (iobuf_available (&self->recvbuf) < 1)
         return (state_t) { receive_signature_a };
     else
-    if (self->recvbuf->base [0] == 0xff)
+    if (self->recvbuf.base [0] == 0xff)
         return receive_signature_b (self, iobuf);
     else {
         const uint64_t peer_id_length =
-            get_uint64 (self->recvbuf->base + 1);
+            get_uint64 (self->recvbuf.base + 1);
         if (peer_id_length > 0)
             self->next_stage = zmtp_v1_exchange_id_new_protocol_engine (
                      self->socket_id, peer_id_length - 1);
@@ -221,19 +215,19 @@ receive_signature_a (zmtp_handshake_t *self, iobuf_t *iobuf)
 static state_t
 receive_signature_b (zmtp_handshake_t *self, iobuf_t *iobuf)
 {
-    const size_t n = zmtp_signature_size - iobuf_available (self->recvbuf);
-    iobuf_copy (self->recvbuf, iobuf, n);
-    if (iobuf_available (self->recvbuf) < zmtp_signature_size)
+    const size_t n = zmtp_signature_size - iobuf_available (&self->recvbuf);
+    iobuf_copy (&self->recvbuf, iobuf, n);
+    if (iobuf_available (&self->recvbuf) < zmtp_signature_size)
         return (state_t) { receive_signature_b };
     else
-    if ((self->recvbuf->base [9] & 0x01) == 0x01) {
-        const size_t n = iobuf_write_byte (self->sendbuf, zmtp_3_0);
+    if ((self->recvbuf.base [9] & 0x01) == 0x01) {
+        const size_t n = iobuf_write_byte (&self->sendbuf, zmtp_3_0);
         assert (n == 1);
         return receive_zmtp_version (self, iobuf);
     }
     else {
         const uint64_t peer_id_length =
-            get_uint64 (self->recvbuf->base + 1);
+            get_uint64 (self->recvbuf.base + 1);
         if (peer_id_length > 0)
             self->next_stage = zmtp_v1_exchange_id_new_protocol_engine (
                      self->socket_id, peer_id_length - 1);
@@ -244,28 +238,28 @@ receive_signature_b (zmtp_handshake_t *self, iobuf_t *iobuf)
 static state_t
 receive_zmtp_version (zmtp_handshake_t *self, iobuf_t *iobuf)
 {
-    const size_t n = iobuf_copy (self->recvbuf, iobuf, 1);
+    const size_t n = iobuf_copy (&self->recvbuf, iobuf, 1);
     if (n == 0)
         return (state_t) { receive_zmtp_version };
 
     const uint8_t zmtp_version =
-        self->recvbuf->base [zmtp_version_offset];
+        self->recvbuf.base [zmtp_version_offset];
 
     if (zmtp_version == zmtp_1_0 || zmtp_version == zmtp_2_0) {
-        const size_t rc = iobuf_write_byte (self->sendbuf, 0);
+        const size_t rc = iobuf_write_byte (&self->sendbuf, 0);
         assert (rc == 1);
         return receive_zmtp_v2_greeting (self, iobuf);
     }
     else {
-        size_t n = iobuf_write_byte (self->sendbuf, 0);
+        size_t n = iobuf_write_byte (&self->sendbuf, 0);
         assert (n == 1);
         char mechanism [20] = { 'N', 'U', 'L', 'L' };
-        n = iobuf_write (self->sendbuf, mechanism, sizeof mechanism);
+        n = iobuf_write (&self->sendbuf, mechanism, sizeof mechanism);
         assert (n == sizeof mechanism);
-        n = iobuf_write_byte (self->sendbuf, 0);
+        n = iobuf_write_byte (&self->sendbuf, 0);
         assert (n == 1);
         const char filler [31] = { 0 };
-        n = iobuf_write (self->sendbuf, filler, sizeof filler);
+        n = iobuf_write (&self->sendbuf, filler, sizeof filler);
         assert (n == sizeof filler);
         return receive_zmtp_v3_greeting (self, iobuf);
     }
@@ -274,10 +268,10 @@ receive_zmtp_version (zmtp_handshake_t *self, iobuf_t *iobuf)
 static state_t
 receive_zmtp_v2_greeting (zmtp_handshake_t *self, iobuf_t *iobuf)
 {
-    const size_t n = zmtp_v2_greeting_size - iobuf_available (self->recvbuf);
-    iobuf_copy (self->recvbuf, iobuf, n);
+    const size_t n = zmtp_v2_greeting_size - iobuf_available (&self->recvbuf);
+    iobuf_copy (&self->recvbuf, iobuf, n);
 
-    if (iobuf_available (self->recvbuf) < zmtp_v2_greeting_size)
+    if (iobuf_available (&self->recvbuf) < zmtp_v2_greeting_size)
         return (state_t) { receive_zmtp_v2_greeting };
 
     return (state_t) { NULL };
@@ -286,10 +280,10 @@ receive_zmtp_v2_greeting (zmtp_handshake_t *self, iobuf_t *iobuf)
 static state_t
 receive_zmtp_v3_greeting (zmtp_handshake_t *self, iobuf_t *iobuf)
 {
-    const size_t n = zmtp_v3_greeting_size - iobuf_available (self->recvbuf);
-    iobuf_copy (self->recvbuf, iobuf, n);
+    const size_t n = zmtp_v3_greeting_size - iobuf_available (&self->recvbuf);
+    iobuf_copy (&self->recvbuf, iobuf, n);
 
-    if (iobuf_available (self->recvbuf) < zmtp_v3_greeting_size)
+    if (iobuf_available (&self->recvbuf) < zmtp_v3_greeting_size)
         return (state_t) { receive_zmtp_v3_greeting };
 
     self->next_stage = zmtp_null_handshake_new_protocol_engine ();
@@ -165,6 +165,16 @@ s_destroy (protocol_engine_t **base_p)
     }
 }
 
+static int
+s_set_max_msg_size (protocol_engine_t *base, size_t max_msg_size)
+{
+    zmtp_null_handshake_t *self = (zmtp_null_handshake_t *) base;
+    assert (self);
+
+    zmtp_v2_frame_decoder_set_max_size (self->decoder, max_msg_size);
+    return 0;
+}
+
 static int
 process_msg (zmtp_null_handshake_t *self, pdu_t *pdu)
 {
@@ -181,6 +191,7 @@ static struct protocol_engine_ops ops = {
     .init = s_init,
     .read = s_read,
     .write = s_write,
+    .set_max_msg_size = s_set_max_msg_size,
     .destroy = s_destroy,
 };
 
@@ -21,12 +21,12 @@ uint64_t
 get_uint64 (const uint8_t *ptr)
 {
     return
-        (uint64_t) ptr [1] << 56 ||
-        (uint64_t) ptr [2] << 48 ||
-        (uint64_t) ptr [3] << 40 ||
-        (uint64_t) ptr [4] << 32 ||
-        (uint64_t) ptr [5] << 24 ||
-        (uint64_t) ptr [6] << 16 ||
-        (uint64_t) ptr [7] << 8  ||
-        (uint64_t) ptr [8];
+        (uint64_t) ptr [0] << 56 |
+        (uint64_t) ptr [1] << 48 |
+        (uint64_t) ptr [2] << 40 |
+        (uint64_t) ptr [3] << 32 |
+        (uint64_t) ptr [4] << 24 |
+        (uint64_t) ptr [5] << 16 |
+        (uint64_t) ptr [6] << 8  |
+        (uint64_t) ptr [7];
 }
@@ -15,9 +15,11 @@
 
 struct zmtp_v1_exchange_id {
     protocol_engine_t base;
-    iobuf_t *sendbuf;
-    iobuf_t *recvbuf;
+    iobuf_t sendbuf;
+    iobuf_t recvbuf;
     protocol_engine_t *next_stage;
+    //  Storage for both buffers, allocated along with the object
+    uint8_t data [];
 };
 
 typedef struct zmtp_v1_exchange_id zmtp_v1_exchange_id_t;
@@ -27,26 +29,18 @@ static struct protocol_engine_ops ops;
 zmtp_v1_exchange_id_t *
 s_new (const char *id, size_t peer_id_length)
 {
-    zmtp_v1_exchange_id_t *self =
-        (zmtp_v1_exchange_id_t *) malloc (sizeof *self);
+    const size_t id_length = id ? strlen (id) : 0;
+    zmtp_v1_exchange_id_t *self = (zmtp_v1_exchange_id_t *)
+        malloc (sizeof *self + id_length + peer_id_length);
     if (self) {
-        const size_t id_length = id ? strlen (id) : 0;
         *self = (zmtp_v1_exchange_id_t) {
             .base.ops = ops,
-            .sendbuf = iobuf_new (id_length),
-            .recvbuf = iobuf_new (peer_id_length),
         };
+        iobuf_init (&self->sendbuf, self->data, id_length);
+        iobuf_init (&self->recvbuf, self->data + id_length, peer_id_length);
 
-        if (self->sendbuf == NULL || self->recvbuf == NULL) {
-            iobuf_destroy (&self->sendbuf);
-            iobuf_destroy (&self->recvbuf);
-            free (self);
-            self = NULL;
-        }
-        else {
-            const size_t n = iobuf_write (self->sendbuf, id, id_length);
-            assert (n == id_length);
-        }
+        const size_t n = iobuf_write (&self->sendbuf, id, id_length);
+        assert (n == id_length);
     }
 
     return self;
@@ -70,11 +64,11 @@ s_read (protocol_engine_t *base, iobuf_t *iobuf, protocol_engine_info_t *info)
     zmtp_v1_exchange_id_t *self = (zmtp_v1_exchange_id_t *) base;
     assert (self);
 
-    iobuf_copy_all (iobuf, self->sendbuf);
+    iobuf_copy_all (iobuf, &self->sendbuf);
     unsigned int flags = 0;
-    if (iobuf_available (self->sendbuf) > 0)
+    if (iobuf_available (&self->sendbuf) > 0)
         flags |= ZKERNEL_READ_OK;
-    if (iobuf_space (self->recvbuf) > 0)
+    if (iobuf_space (&self->recvbuf) > 0)
         flags |= ZKERNEL_WRITE_OK;
     if (flags == 0) {
         self->next_stage = zmtp_v1_frame_codec_new_protocol_engine ();
@@ -92,11 +86,11 @@ s_write (protocol_engine_t *base, iobuf_t *iobuf, protocol_engine_info_t *info)
     zmtp_v1_exchange_id_t *self = (zmtp_v1_exchange_id_t *) base;
     assert (self);
 
-    iobuf_copy_all (self->recvbuf, iobuf);
+    iobuf_copy_all (&self->recvbuf, iobuf);
     unsigned int flags = 0;
-    if (iobuf_available (self->sendbuf) > 0)
+    if (iobuf_available (&self->sendbuf) > 0)
         flags |= ZKERNEL_READ_OK;
-    if (iobuf_space (self->recvbuf) > 0)
+    if (iobuf_space (&self->recvbuf) > 0)
         flags |= ZKERNEL_WRITE_OK;
     if (flags == 0) {
         self->next_stage = zmtp_v1_frame_codec_new_protocol_engine ();
@@ -114,8 +108,6 @@ s_next (protocol_engine_t **base_p, protocol_engine_info_t *info)
     assert (base_p);
     if (*base_p) {
         zmtp_v1_exchange_id_t *self = (zmtp_v1_exchange_id_t *) *base_p;
-        iobuf_destroy (&self->sendbuf);
-        iobuf_destroy (&self->recvbuf);
         *base_p = self->next_stage;
         free (self);
     }
@@ -127,8 +119,6 @@ s_destroy (protocol_engine_t **base_p)
     assert (base_p);
     if (*base_p) {
         zmtp_v1_exchange_id_t *self = (zmtp_v1_exchange_id_t *) *base_p;
-        iobuf_destroy (&self->sendbuf);
-        iobuf_destroy (&self->recvbuf);
         *base_p = NULL;
         free (self);
     }
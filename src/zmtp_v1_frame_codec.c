@@ -5,11 +5,13 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 
 #include "zmtp_v1_frame_encoder.h"
 #include "zmtp_v1_frame_decoder.h"
 #include "protocol_engine.h"
+#include "zkernel.h"
 
 struct zmtp_v1_frame_codec {
     protocol_engine_t base;
@@ -23,6 +25,25 @@ typedef struct zmtp_v1_frame_codec zmtp_v1_frame_codec_t;
 
 static struct protocol_engine_ops ops;
 
+//  Encoder and decoder flags share bit values; map them onto the
+//  protocol engine flags.
+
+static uint32_t
+s_flags (zmtp_v1_frame_encoder_info_t *encoder_info,
+    zmtp_v1_frame_decoder_info_t *decoder_info)
+{
+    uint32_t flags = 0;
+    if ((encoder_info->flags & ZMTP_V1_FRAME_ENCODER_READY) != 0)
+        flags |= ZKERNEL_ENCODER_READY;
+    if ((encoder_info->flags & ZMTP_V1_FRAME_ENCODER_READ_OK) != 0)
+        flags |= ZKERNEL_READ_OK;
+    if ((decoder_info->flags & ZMTP_V1_FRAME_DECODER_READY) != 0)
+        flags |= ZKERNEL_DECODER_READY;
+    if ((decoder_info->flags & ZMTP_V1_FRAME_DECODER_WRITE_OK) != 0)
+        flags |= ZKERNEL_WRITE_OK;
+    return flags;
+}
+
 static zmtp_v1_frame_codec_t *
 s_new ()
 {
@@ -59,7 +80,7 @@ s_init (protocol_engine_t *base, protocol_engine_info_t *info)
         &self->decoder_info;
 
     *info = (protocol_engine_info_t) {
-        .flags = encoder_info->flags | decoder_info->flags,
+        .flags = s_flags (encoder_info, decoder_info),
         .read_buffer = encoder_info->buffer,
         .read_buffer_size = encoder_info->buffer_size,
         .write_buffer = decoder_info->buffer,
@@ -86,7 +107,7 @@ s_encode (protocol_engine_t *base, pdu_t *pdu, protocol_engine_info_t *info)
         return -1;
 
     *info = (protocol_engine_info_t) {
-        .flags = encoder_info->flags | decoder_info->flags,
+        .flags = s_flags (encoder_info, decoder_info),
         .read_buffer = encoder_info->buffer,
         .read_buffer_size = encoder_info->buffer_size,
         .write_buffer = decoder_info->buffer,
@@ -113,14 +134,14 @@ s_decode (protocol_engine_t *base, protocol_engine_info_t *info)
         return pdu;
 
     *info = (protocol_engine_info_t) {
-        .flags = encoder_info->flags | decoder_info->flags,
+        .flags = s_flags (encoder_info, decoder_info),
         .read_buffer = encoder_info->buffer,
         .read_buffer_size = encoder_info->buffer_size,
         .write_buffer = decoder_info->buffer,
         .write_buffer_size = decoder_info->buffer_size,
     };
 
-    return 0;
+    return pdu;
 }
 
 static int
@@ -140,7 +161,7 @@ s_read (protocol_engine_t *base, iobuf_t *iobuf, protocol_engine_info_t *info)
         return -1;
 
     *info = (protocol_engine_info_t) {
-        .flags = encoder_info->flags | decoder_info->flags,
+        .flags = s_flags (encoder_info, decoder_info),
         .read_buffer = encoder_info->buffer,
         .read_buffer_size = encoder_info->buffer_size,
         .write_buffer = decoder_info->buffer,
@@ -167,7 +188,7 @@ s_read_advance (protocol_engine_t *base, size_t n, protocol_engine_info_t *info)
         return -1;
 
     *info = (protocol_engine_info_t) {
-        .flags = encoder_info->flags | decoder_info->flags,
+        .flags = s_flags (encoder_info, decoder_info),
         .read_buffer = encoder_info->buffer,
         .read_buffer_size = encoder_info->buffer_size,
         .write_buffer = decoder_info->buffer,
@@ -194,7 +215,7 @@ s_write (protocol_engine_t *base, iobuf_t *iobuf, protocol_engine_info_t *info)
         return -1;
 
     *info = (protocol_engine_info_t) {
-        .flags = encoder_info->flags | decoder_info->flags,
+        .flags = s_flags (encoder_info, decoder_info),
         .read_buffer = encoder_info->buffer,
         .read_buffer_size = encoder_info->buffer_size,
         .write_buffer = decoder_info->buffer,
@@ -221,7 +242,7 @@ s_write_advance (protocol_engine_t *base, size_t n, protocol_engine_info_t *info
         return -1;
 
     *info = (protocol_engine_info_t) {
-        .flags = encoder_info->flags | decoder_info->flags,
+        .flags = s_flags (encoder_info, decoder_info),
         .read_buffer = encoder_info->buffer,
         .read_buffer_size = encoder_info->buffer_size,
         .write_buffer = decoder_info->buffer,
@@ -245,6 +266,16 @@ s_destroy (protocol_engine_t **base_p)
     }
 }
 
+static int
+s_set_max_msg_size (protocol_engine_t *base, size_t max_msg_size)
+{
+    zmtp_v1_frame_codec_t *self = (zmtp_v1_frame_codec_t *) base;
+    assert (self);
+
+    zmtp_v1_frame_decoder_set_max_size (self->decoder, max_msg_size);
+    return 0;
+}
+
 static struct protocol_engine_ops ops = {
     .init = s_init,
     .encode = s_encode,
@@ -253,6 +284,7 @@ static struct protocol_engine_ops ops = {
     .decode = s_decode,
     .write = s_write,
     .write_advance = s_write_advance,
+    .set_max_msg_size = s_set_max_msg_size,
     .destroy = s_destroy,
 };
 
@@ -6,6 +6,7 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "iobuf.h"
 #include "pdu.h"
@@ -19,6 +20,8 @@ struct zmtp_v1_frame_decoder {
     pdu_t *pdu;
     uint8_t *ptr;
     size_t bytes_left;
+    //  Longest frame accepted; 0 means no limit
+    size_t max_size;
 };
 
 #define DECODING_LENGTH     0
@@ -44,6 +47,14 @@ zmtp_v1_frame_decoder_new (zmtp_v1_frame_decoder_info_t *info)
     return self;
 }
 
+void
+zmtp_v1_frame_decoder_set_max_size (
+    zmtp_v1_frame_decoder_t *self, size_t max_size)
+{
+    assert (self);
+    self->max_size = max_size;
+}
+
 int
 zmtp_v1_frame_decoder_write (zmtp_v1_frame_decoder_t *self,
     iobuf_t *iobuf, zmtp_v1_frame_decoder_info_t *info)
@@ -89,10 +100,16 @@ zmtp_v1_frame_decoder_write (zmtp_v1_frame_decoder_t *self,
         const size_t n =
             iobuf_read (iobuf, self->buffer, 1);
         if (n == 1) {
-            // process flags
-            self->pdu = pdu_new_with_size (self->frame_size);
+            //  Length comes from the peer; check it before allocating
+            if (self->frame_size > SIZE_MAX
+                    || (self->max_size > 0
+                        && self->frame_size > self->max_size))
+                return -1;
+            self->pdu = pdu_new_with_size ((size_t) self->frame_size);
             if (self->pdu == NULL)
                 return -1;
+            if ((self->buffer [0] & 0x01) == 0x01)
+                self->pdu->flags |= PDU_MORE;
             self->ptr = self->pdu->pdu_data;
             self->bytes_left = self->frame_size;
             self->state = DECODING_BODY;
@@ -27,6 +27,12 @@ typedef struct zmtp_v1_frame_decoder_info zmtp_v1_frame_decoder_info_t;
 zmtp_v1_frame_decoder_t *
     zmtp_v1_frame_decoder_new (zmtp_v1_frame_decoder_info_t *info);
 
+//  Fail writes that meet a frame longer than max_size, before its
+//  body is allocated. 0, the default, means no limit.
+void
+    zmtp_v1_frame_decoder_set_max_size (
+        zmtp_v1_frame_decoder_t *self, size_t max_size);
+
 int
     zmtp_v1_frame_decoder_write (zmtp_v1_frame_decoder_t *self,
         iobuf_t *iobuf, zmtp_v1_frame_decoder_info_t *info);
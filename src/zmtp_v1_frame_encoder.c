@@ -49,18 +49,20 @@ zmtp_v1_frame_encoder_putmsg (zmtp_v1_frame_encoder_t *self,
 
     self->pdu = pdu;
     uint8_t *buffer = self->ptr = self->buffer;
+    const uint8_t flags = (pdu->flags & PDU_MORE) == PDU_MORE? 0x01: 0;
 
     if (pdu->pdu_size < 255) {
         buffer [0] = pdu->pdu_size + 1;
-        buffer [1] = 0; // flags
+        buffer [1] = flags;
         self->bytes_left = 2;
     }
     else {
         buffer [0] = 0xff;
         put_uint64 (buffer + 1, pdu->pdu_size + 1);
-        buffer [9] = 0; // flags
+        buffer [9] = flags;
         self->bytes_left = 10;
     }
+    self->state = READING_HEADER;
 
     *info = (zmtp_v1_frame_encoder_info_t) {
         .flags = ZMTP_V1_FRAME_ENCODER_READ_OK,
@@ -102,7 +104,8 @@ zmtp_v1_frame_encoder_read (zmtp_v1_frame_encoder_t *self,
         }
     }
 
-    if (self->state == WAITING_FOR_FRAME || self->state == READING_HEADER)
+    //  A header cut short by a full buffer still has bytes to hand out
+    if (self->state == WAITING_FOR_FRAME)
         *info = (zmtp_v1_frame_encoder_info_t) {
             .flags = ZMTP_V1_FRAME_ENCODER_READY,
         };
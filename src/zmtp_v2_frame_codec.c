@@ -5,11 +5,17 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 
 #include "zmtp_v2_frame_encoder.h"
 #include "zmtp_v2_frame_decoder.h"
 #include "protocol_engine.h"
+#include "zkernel.h"
+
+//  Frames decoded per write, so that one read from the socket
+//  can be delivered to the owner in one go
+#define ZMTP_V2_FRAME_CODEC_DECODE_BATCH    64
 
 struct zmtp_v2_frame_codec {
     protocol_engine_t base;
@@ -23,6 +29,25 @@ typedef struct zmtp_v2_frame_codec zmtp_v2_frame_codec_t;
 
 static struct protocol_engine_ops ops;
 
+//  Encoder and decoder flags share bit values; map them onto the
+//  protocol engine flags.
+
+static uint32_t
+s_flags (zmtp_v2_frame_encoder_info_t *encoder_info,
+    zmtp_v2_frame_decoder_info_t *decoder_info)
+{
+    uint32_t flags = 0;
+    if ((encoder_info->flags & ZMTP_V2_FRAME_ENCODER_READY) != 0)
+        flags |= ZKERNEL_ENCODER_READY;
+    if ((encoder_info->flags & ZMTP_V2_FRAME_ENCODER_READ_OK) != 0)
+        flags |= ZKERNEL_READ_OK;
+    if ((decoder_info->flags & ZMTP_V2_FRAME_DECODER_READY) != 0)
+        flags |= ZKERNEL_DECODER_READY;
+    if ((decoder_info->flags & ZMTP_V2_FRAME_DECODER_WRITE_OK) != 0)
+        flags |= ZKERNEL_WRITE_OK;
+    return flags;
+}
+
 static zmtp_v2_frame_codec_t *
 s_new ()
 {
@@ -42,6 +67,9 @@ s_new ()
             free (self);
             self = NULL;
         }
+        else
+            zmtp_v2_frame_decoder_set_batch_size (
+                self->decoder, ZMTP_V2_FRAME_CODEC_DECODE_BATCH);
     }
 
     return self;
@@ -59,7 +87,7 @@ s_init (protocol_engine_t *base, protocol_engine_info_t *info)
         &self->decoder_info;
 
     *info = (protocol_engine_info_t) {
-        .flags = encoder_info->flags | decoder_info->flags,
+        .flags = s_flags (encoder_info, decoder_info),
         .read_buffer = encoder_info->buffer,
         .read_buffer_size = encoder_info->buffer_size,
         .write_buffer = decoder_info->buffer,
@@ -86,7 +114,7 @@ s_encode (protocol_engine_t *base, pdu_t *pdu, protocol_engine_info_t *info)
         return -1;
 
     *info = (protocol_engine_info_t) {
-        .flags = encoder_info->flags | decoder_info->flags,
+        .flags = s_flags (encoder_info, decoder_info),
         .read_buffer = encoder_info->buffer,
         .read_buffer_size = encoder_info->buffer_size,
         .write_buffer = decoder_info->buffer,
@@ -113,14 +141,14 @@ s_decode (protocol_engine_t *base, protocol_engine_info_t *info)
         return pdu;
 
     *info = (protocol_engine_info_t) {
-        .flags = encoder_info->flags | decoder_info->flags,
+        .flags = s_flags (encoder_info, decoder_info),
         .read_buffer = encoder_info->buffer,
         .read_buffer_size = encoder_info->buffer_size,
         .write_buffer = decoder_info->buffer,
         .write_buffer_size = decoder_info->buffer_size,
     };
 
-    return 0;
+    return pdu;
 }
 
 static int
@@ -140,7 +168,7 @@ s_read (protocol_engine_t *base, iobuf_t *iobuf, protocol_engine_info_t *info)
         return -1;
 
     *info = (protocol_engine_info_t) {
-        .flags = encoder_info->flags | decoder_info->flags,
+        .flags = s_flags (encoder_info, decoder_info),
         .read_buffer = encoder_info->buffer,
         .read_buffer_size = encoder_info->buffer_size,
         .write_buffer = decoder_info->buffer,
@@ -167,7 +195,7 @@ s_read_advance (protocol_engine_t *base, size_t n, protocol_engine_info_t *info)
         return -1;
 
     *info = (protocol_engine_info_t) {
-        .flags = encoder_info->flags | decoder_info->flags,
+        .flags = s_flags (encoder_info, decoder_info),
         .read_buffer = encoder_info->buffer,
         .read_buffer_size = encoder_info->buffer_size,
         .write_buffer = decoder_info->buffer,
@@ -177,6 +205,15 @@ s_read_advance (protocol_engine_t *base, size_t n, protocol_engine_info_t *info)
     return 0;
 }
 
+static int
+s_iovec (protocol_engine_t *base, struct iovec *iov, int iovcnt)
+{
+    zmtp_v2_frame_codec_t *self = (zmtp_v2_frame_codec_t *) base;
+    assert (self);
+
+    return zmtp_v2_frame_encoder_iovec (self->encoder, iov, iovcnt);
+}
+
 static int
 s_write (protocol_engine_t *base, iobuf_t *iobuf, protocol_engine_info_t *info)
 {
@@ -194,7 +231,7 @@ s_write (protocol_engine_t *base, iobuf_t *iobuf, protocol_engine_info_t *info)
         return -1;
 
     *info = (protocol_engine_info_t) {
-        .flags = encoder_info->flags | decoder_info->flags,
+        .flags = s_flags (encoder_info, decoder_info),
         .read_buffer = encoder_info->buffer,
         .read_buffer_size = encoder_info->buffer_size,
         .write_buffer = decoder_info->buffer,
@@ -221,7 +258,7 @@ s_write_advance (protocol_engine_t *base, size_t n, protocol_engine_info_t *info
         return -1;
 
     *info = (protocol_engine_info_t) {
-        .flags = encoder_info->flags | decoder_info->flags,
+        .flags = s_flags (encoder_info, decoder_info),
         .read_buffer = encoder_info->buffer,
         .read_buffer_size = encoder_info->buffer_size,
         .write_buffer = decoder_info->buffer,
@@ -245,14 +282,26 @@ s_destroy (protocol_engine_t **base_p)
     }
 }
 
+static int
+s_set_max_msg_size (protocol_engine_t *base, size_t max_msg_size)
+{
+    zmtp_v2_frame_codec_t *self = (zmtp_v2_frame_codec_t *) base;
+    assert (self);
+
+    zmtp_v2_frame_decoder_set_max_size (self->decoder, max_msg_size);
+    return 0;
+}
+
 static struct protocol_engine_ops ops = {
     .init = s_init,
     .encode = s_encode,
     .read = s_read,
     .read_advance = s_read_advance,
+    .iovec = s_iovec,
     .decode = s_decode,
     .write = s_write,
     .write_advance = s_write_advance,
+    .set_max_msg_size = s_set_max_msg_size,
     .destroy = s_destroy,
 };
 
@@ -6,6 +6,7 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "iobuf.h"
 #include "pdu.h"
@@ -18,6 +19,14 @@ struct zmtp_v2_frame_decoder {
     pdu_t *pdu;
     uint8_t *ptr;
     size_t bytes_left;
+    //  Decoded frames, linked through base.next
+    pdu_t *ready;
+    pdu_t *ready_tail;
+    size_t ready_count;
+    //  Number of frames decoded before the decoder stops taking input
+    size_t batch_size;
+    //  Longest frame accepted; 0 means no limit
+    size_t max_size;
 };
 
 typedef struct zmtp_v2_frame_decoder zmtp_v2_frame_decoder_t;
@@ -25,10 +34,16 @@ typedef struct zmtp_v2_frame_decoder zmtp_v2_frame_decoder_t;
 #define DECODING_FLAGS      0
 #define DECODING_LENGTH     1
 #define DECODING_BODY       2
-#define PDU_READY           3
 
-static size_t
-s_decode_length (const uint8_t *ptr);
+static uint64_t
+    s_decode_length (const uint8_t *ptr);
+
+static void
+    s_frame_done (zmtp_v2_frame_decoder_t *self);
+
+static void
+    s_update_info (
+        zmtp_v2_frame_decoder_t *self, zmtp_v2_frame_decoder_info_t *info);
 
 zmtp_v2_frame_decoder_t *
 zmtp_v2_frame_decoder_new (zmtp_v2_frame_decoder_info_t *info)
@@ -39,73 +54,91 @@ zmtp_v2_frame_decoder_new (zmtp_v2_frame_decoder_info_t *info)
         *self = (zmtp_v2_frame_decoder_t) {
             .state = DECODING_FLAGS,
             .ptr = self->buffer,
-            .bytes_left = 1
-        };
-        *info = (zmtp_v2_frame_decoder_info_t) {
-            .flags = ZMTP_V2_FRAME_DECODER_WRITE_OK
+            .bytes_left = 1,
+            .batch_size = 1
         };
+        s_update_info (self, info);
     }
     return self;
 }
 
+void
+zmtp_v2_frame_decoder_set_batch_size (
+    zmtp_v2_frame_decoder_t *self, size_t batch_size)
+{
+    assert (self);
+    assert (batch_size > 0);
+    self->batch_size = batch_size;
+}
+
+void
+zmtp_v2_frame_decoder_set_max_size (
+    zmtp_v2_frame_decoder_t *self, size_t max_size)
+{
+    assert (self);
+    self->max_size = max_size;
+}
+
 int
 zmtp_v2_frame_decoder_write (zmtp_v2_frame_decoder_t *self,
     iobuf_t *iobuf, zmtp_v2_frame_decoder_info_t *info)
 {
     assert (self);
 
-    if (self->state == PDU_READY)
+    if (self->ready_count >= self->batch_size)
         return -1;
 
-    if (self->state == DECODING_FLAGS) {
-        const size_t n =
-            iobuf_read (iobuf, self->ptr, self->bytes_left);
-        self->ptr += n;
-        self->bytes_left -= n;
-        if (self->bytes_left == 0) {
+    //  Decode frames until input runs out or the batch is full
+    while (self->ready_count < self->batch_size) {
+        if (self->state == DECODING_FLAGS) {
+            const size_t n =
+                iobuf_read (iobuf, self->ptr, self->bytes_left);
+            self->ptr += n;
+            self->bytes_left -= n;
+            if (self->bytes_left > 0)
+                break;
             if ((self->buffer [0] & 0x02) == 0x02)
                 self->bytes_left = 8;
             else
                 self->bytes_left = 1;
             self->state = DECODING_LENGTH;
         }
-    }
 
-    if (self->state == DECODING_LENGTH) {
-        const size_t n =
-            iobuf_read (iobuf, self->ptr, self->bytes_left);
-        self->ptr += n;
-        self->bytes_left -= n;
-        if (self->bytes_left == 0) {
-            const size_t pdu_size = (size_t) s_decode_length (self->buffer);
+        if (self->state == DECODING_LENGTH) {
+            const size_t n =
+                iobuf_read (iobuf, self->ptr, self->bytes_left);
+            self->ptr += n;
+            self->bytes_left -= n;
+            if (self->bytes_left > 0)
+                break;
+            const uint64_t length = s_decode_length (self->buffer);
+            //  Length comes from the peer; check it before allocating
+            if (length > SIZE_MAX
+                    || (self->max_size > 0 && length > self->max_size))
+                return -1;
+            const size_t pdu_size = (size_t) length;
             self->pdu = pdu_new_with_size (pdu_size);
             if (self->pdu == NULL)
                 return -1;
+            if ((self->buffer [0] & 0x01) == 0x01)
+                self->pdu->flags |= PDU_MORE;
             self->ptr = self->pdu->pdu_data;
             self->bytes_left = pdu_size;
             self->state = DECODING_BODY;
         }
-    }
 
-    if (self->state == DECODING_BODY) {
-        const size_t n =
-            iobuf_read (iobuf, self->ptr, self->bytes_left);
-        self->ptr += n;
-        self->bytes_left -= n;
-        if (self->bytes_left == 0)
-            self->state = PDU_READY;
+        if (self->state == DECODING_BODY) {
+            const size_t n =
+                iobuf_read (iobuf, self->ptr, self->bytes_left);
+            self->ptr += n;
+            self->bytes_left -= n;
+            if (self->bytes_left > 0)
+                break;
+            s_frame_done (self);
+        }
     }
 
-    if (self->state == PDU_READY)
-        *info = (zmtp_v2_frame_decoder_info_t) {
-            .flags = ZMTP_V2_FRAME_DECODER_READY
-        };
-    else
-        *info = (zmtp_v2_frame_decoder_info_t) {
-            .flags = ZMTP_V2_FRAME_DECODER_WRITE_OK,
-            .buffer = self->ptr,
-            .buffer_size = self->bytes_left,
-        };
+    s_update_info (self, info);
 
     return 0;
 }
@@ -125,18 +158,9 @@ zmtp_v2_frame_decoder_advance (
     self->bytes_left -= n;
 
     if (self->bytes_left == 0)
-        self->state = PDU_READY;
+        s_frame_done (self);
 
-    if (self->state == PDU_READY)
-        *info = (zmtp_v2_frame_decoder_info_t) {
-            .flags = ZMTP_V2_FRAME_DECODER_READY
-        };
-    else
-        *info = (zmtp_v2_frame_decoder_info_t) {
-            .flags = ZMTP_V2_FRAME_DECODER_WRITE_OK,
-            .buffer = self->ptr,
-            .buffer_size = self->bytes_left,
-        };
+    s_update_info (self, info);
 
     return 0;
 }
@@ -147,18 +171,17 @@ zmtp_v2_frame_decoder_getmsg (
 {
     assert (self);
 
-    if (self->state != PDU_READY)
+    pdu_t *pdu = self->ready;
+    if (pdu == NULL)
         return NULL;
 
-    pdu_t *pdu = self->pdu;
-    self->pdu = NULL;
-    self->state = DECODING_FLAGS;
-    self->ptr = self->buffer;
-    self->bytes_left = 1;
+    self->ready = (pdu_t *) pdu->base.next;
+    if (self->ready == NULL)
+        self->ready_tail = NULL;
+    self->ready_count--;
+    pdu->base.next = NULL;
 
-    *info = (zmtp_v2_frame_decoder_info_t) {
-        .flags = ZMTP_V2_FRAME_DECODER_WRITE_OK
-    };
+    s_update_info (self, info);
 
     return pdu;
 }
@@ -169,12 +192,50 @@ zmtp_v2_frame_decoder_destroy (zmtp_v2_frame_decoder_t **self_p)
     assert (self_p);
     if (*self_p) {
         zmtp_v2_frame_decoder_t *self = (zmtp_v2_frame_decoder_t *) *self_p;
+        zmtp_v2_frame_decoder_info_t info;
+        pdu_t *pdu;
+        while ((pdu = zmtp_v2_frame_decoder_getmsg (self, &info)))
+            pdu_destroy (&pdu);
         pdu_destroy (&self->pdu);
         free (self);
         *self_p = NULL;
     }
 }
 
+//  Queue the frame just decoded and start on the next one
+
+static void
+s_frame_done (zmtp_v2_frame_decoder_t *self)
+{
+    pdu_t *pdu = self->pdu;
+    self->pdu = NULL;
+    pdu->base.next = NULL;
+    if (self->ready_tail)
+        self->ready_tail->base.next = &pdu->base;
+    else
+        self->ready = pdu;
+    self->ready_tail = pdu;
+    self->ready_count++;
+
+    self->state = DECODING_FLAGS;
+    self->ptr = self->buffer;
+    self->bytes_left = 1;
+}
+
+static void
+s_update_info (
+    zmtp_v2_frame_decoder_t *self, zmtp_v2_frame_decoder_info_t *info)
+{
+    *info = (zmtp_v2_frame_decoder_info_t) { .flags = 0 };
+    if (self->ready_count > 0)
+        info->flags |= ZMTP_V2_FRAME_DECODER_READY;
+    if (self->ready_count < self->batch_size) {
+        info->flags |= ZMTP_V2_FRAME_DECODER_WRITE_OK;
+        info->buffer = self->ptr;
+        info->buffer_size = self->bytes_left;
+    }
+}
+
 static uint64_t
 s_decode_length (const uint8_t *ptr)
 {
@@ -23,6 +23,19 @@ typedef struct zmtp_v2_frame_decoder_info zmtp_v2_frame_decoder_info_t;
 zmtp_v2_frame_decoder_t *
     zmtp_v2_frame_decoder_new (zmtp_v2_frame_decoder_info_t *info);
 
+//  Let the decoder parse up to batch_size frames per write before
+//  the caller has to collect them. Defaults to 1, so that no input
+//  past the first frame is consumed.
+void
+    zmtp_v2_frame_decoder_set_batch_size (
+        zmtp_v2_frame_decoder_t *self, size_t batch_size);
+
+//  Fail writes that meet a frame longer than max_size, before its
+//  body is allocated. 0, the default, means no limit.
+void
+    zmtp_v2_frame_decoder_set_max_size (
+        zmtp_v2_frame_decoder_t *self, size_t max_size);
+
 int
     zmtp_v2_frame_decoder_write (zmtp_v2_frame_decoder_t *self,
         iobuf_t *iobuf, zmtp_v2_frame_decoder_info_t *info);
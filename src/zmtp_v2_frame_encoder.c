@@ -10,28 +10,41 @@
 #include "zmtp_utils.h"
 #include "zmtp_v2_frame_encoder.h"
 
-#define WAITING_FOR_PDU     0
-#define READING_HEADER      1
-#define READING_BODY        2
+#define MAX_FRAMES  ZMTP_V2_FRAME_ENCODER_MAX_FRAMES
 
-struct zmtp_v2_frame_encoder {
-    int state;
-    uint8_t buffer [9];
+struct frame {
     pdu_t *pdu;
-    uint8_t *ptr;
+    uint8_t header [9];
+    size_t header_size;
+};
+
+//  Frames are kept in a ring, oldest first. Output of a frame is
+//  its header followed by the PDU body.
+struct zmtp_v2_frame_encoder {
+    struct frame frames [MAX_FRAMES];
+    size_t first;
+    size_t count;
+    //  Bytes of the first frame already written
+    size_t offset;
+    //  Bytes of output not written yet
     size_t bytes_left;
 };
 
+static void
+    s_consume (zmtp_v2_frame_encoder_t *self, size_t n);
+
+static void
+    s_update_info (
+        zmtp_v2_frame_encoder_t *self, zmtp_v2_frame_encoder_info_t *info);
+
 zmtp_v2_frame_encoder_t *
 zmtp_v2_frame_encoder_new (zmtp_v2_frame_encoder_info_t *info)
 {
     zmtp_v2_frame_encoder_t *self =
         (zmtp_v2_frame_encoder_t *) malloc (sizeof *self);
     if (self) {
-        *self = (zmtp_v2_frame_encoder_t) { .state = WAITING_FOR_PDU };
-        *info = (zmtp_v2_frame_encoder_info_t) {
-            .flags = ZMTP_V2_FRAME_ENCODER_READY
-        };
+        *self = (zmtp_v2_frame_encoder_t) { .count = 0 };
+        s_update_info (self, info);
     }
 
     return self;
@@ -43,27 +56,30 @@ zmtp_v2_frame_encoder_putmsg (zmtp_v2_frame_encoder_t *self,
 {
     assert (self);
 
-    if (self->state != WAITING_FOR_PDU)
+    if (self->count == MAX_FRAMES)
         return -1;
 
-    assert (self->pdu == NULL);
-    self->pdu = pdu;
+    struct frame *frame =
+        &self->frames [(self->first + self->count) % MAX_FRAMES];
+    frame->pdu = pdu;
 
-    uint8_t *buffer = self->ptr = self->buffer;
+    uint8_t *buffer = frame->header;
     buffer [0] = 0;     // flags
+    if ((pdu->flags & PDU_MORE) == PDU_MORE)
+        buffer [0] |= 0x01;
     if (pdu->pdu_size > 255) {
         buffer [0] |= 0x02;
         put_uint64 (buffer + 1, pdu->pdu_size);
-        self->bytes_left = 9;
+        frame->header_size = 9;
     }
     else {
         buffer [1] = (uint8_t) pdu->pdu_size;
-        self->bytes_left = 2;
+        frame->header_size = 2;
     }
 
-    *info = (zmtp_v2_frame_encoder_info_t) {
-        .flags = ZMTP_V2_FRAME_ENCODER_READ_OK
-    };
+    self->count++;
+    self->bytes_left += frame->header_size + pdu->pdu_size;
+    s_update_info (self, info);
 
     return 0;
 }
@@ -74,48 +90,20 @@ zmtp_v2_frame_encoder_read (zmtp_v2_frame_encoder_t *self,
 {
     assert (self);
 
-    if (self->state == WAITING_FOR_PDU)
+    if (self->count == 0)
         return -1;
 
-    assert (self->state == READING_HEADER
-         || self->state == READING_BODY);
-
-    if (self->state == READING_HEADER) {
-        const size_t n =
-            iobuf_write (iobuf, self->ptr, self->bytes_left);
-        self->ptr += n;
-        self->bytes_left -= n;
-
-        if (self->bytes_left == 0) {
-            assert (self->pdu);
-            self->ptr = self->pdu->pdu_data;
-            self->bytes_left = self->pdu->pdu_size;
-            self->state = READING_BODY;
-        }
+    zmtp_v2_frame_encoder_info_t span;
+    s_update_info (self, &span);
+    while (span.buffer_size > 0) {
+        const size_t n = iobuf_write (iobuf, span.buffer, span.buffer_size);
+        s_consume (self, n);
+        if (n < span.buffer_size)
+            break;
+        s_update_info (self, &span);
     }
 
-    if (self->state == READING_BODY) {
-        const size_t n =
-            iobuf_write (iobuf, self->ptr, self->bytes_left);
-        self->ptr += n;
-        self->bytes_left -= n;
-
-        if (self->bytes_left == 0) {
-            pdu_destroy (&self->pdu);
-            self->state = WAITING_FOR_PDU;
-        }
-    }
-
-    if (self->state == WAITING_FOR_PDU)
-        *info = (zmtp_v2_frame_encoder_info_t) {
-            .flags = ZMTP_V2_FRAME_ENCODER_READY
-        };
-    else
-        *info = (zmtp_v2_frame_encoder_info_t) {
-            .flags = ZMTP_V2_FRAME_ENCODER_READ_OK,
-            .buffer = self->ptr,
-            .buffer_size = self->bytes_left,
-        };
+    s_update_info (self, info);
 
     return 0;
 }
@@ -126,43 +114,45 @@ zmtp_v2_frame_encoder_advance (zmtp_v2_frame_encoder_t *self,
 {
     assert (self);
 
-    if (self->state == WAITING_FOR_PDU)
+    if (self->count == 0)
         return -1;
-
-    assert (self->state == READING_HEADER
-         || self->state == READING_BODY);
-
     if (n > self->bytes_left)
         return -1;
 
-    self->ptr += n;
-    self->bytes_left -= n;
+    s_consume (self, n);
+    s_update_info (self, info);
 
-    if (self->state == READING_HEADER) {
-        if (self->bytes_left == 0) {
-            pdu_t *pdu = self->pdu;
-            assert (pdu);
-            self->ptr = pdu->pdu_data;
-            self->bytes_left = pdu->pdu_size;
-            self->state = READING_BODY;
-        }
-    }
+    return 0;
+}
+
+int
+zmtp_v2_frame_encoder_iovec (zmtp_v2_frame_encoder_t *self,
+    struct iovec *iov, int iovcnt)
+{
+    assert (self);
 
-    if (self->bytes_left == 0) {
-        pdu_destroy (&self->pdu);
-        self->state = WAITING_FOR_PDU;
-        *info = (zmtp_v2_frame_encoder_info_t) {
-            .flags = ZMTP_V2_FRAME_ENCODER_READY
-        };
+    int n = 0;
+    size_t offset = self->offset;
+    for (size_t i = 0; i < self->count && n < iovcnt; i++) {
+        struct frame *frame = &self->frames [(self->first + i) % MAX_FRAMES];
+        if (offset < frame->header_size) {
+            iov [n++] = (struct iovec) {
+                .iov_base = frame->header + offset,
+                .iov_len = frame->header_size - offset
+            };
+            offset = 0;
+        }
+        else
+            offset -= frame->header_size;
+        if (n < iovcnt && offset < frame->pdu->pdu_size)
+            iov [n++] = (struct iovec) {
+                .iov_base = frame->pdu->pdu_data + offset,
+                .iov_len = frame->pdu->pdu_size - offset
+            };
+        offset = 0;
     }
-    else
-        *info = (zmtp_v2_frame_encoder_info_t) {
-            .flags = ZMTP_V2_FRAME_ENCODER_READ_OK,
-            .buffer = self->ptr,
-            .buffer_size = self->bytes_left,
-        };
 
-    return 0;
+    return n;
 }
 
 void
@@ -170,9 +160,52 @@ zmtp_v2_frame_encoder_destroy (zmtp_v2_frame_encoder_t **self_p)
 {
     if (*self_p) {
         zmtp_v2_frame_encoder_t *self = (zmtp_v2_frame_encoder_t *) *self_p;
-        if (self->pdu)
-            pdu_destroy (&self->pdu);
+        for (size_t i = 0; i < self->count; i++)
+            pdu_destroy (&self->frames [(self->first + i) % MAX_FRAMES].pdu);
         free (self);
         *self_p = NULL;
     }
 }
+
+//  Drop n bytes of output, releasing frames written completely
+
+static void
+s_consume (zmtp_v2_frame_encoder_t *self, size_t n)
+{
+    assert (n <= self->bytes_left);
+    self->bytes_left -= n;
+    n += self->offset;
+    while (self->count > 0) {
+        struct frame *frame = &self->frames [self->first];
+        const size_t frame_size = frame->header_size + frame->pdu->pdu_size;
+        if (n < frame_size)
+            break;
+        n -= frame_size;
+        pdu_destroy (&frame->pdu);
+        self->first = (self->first + 1) % MAX_FRAMES;
+        self->count--;
+    }
+    self->offset = n;
+}
+
+static void
+s_update_info (
+    zmtp_v2_frame_encoder_t *self, zmtp_v2_frame_encoder_info_t *info)
+{
+    *info = (zmtp_v2_frame_encoder_info_t) { .flags = 0 };
+    if (self->count < MAX_FRAMES)
+        info->flags |= ZMTP_V2_FRAME_ENCODER_READY;
+    if (self->count > 0) {
+        struct frame *frame = &self->frames [self->first];
+        info->flags |= ZMTP_V2_FRAME_ENCODER_READ_OK;
+        if (self->offset < frame->header_size) {
+            info->buffer = frame->header + self->offset;
+            info->buffer_size = frame->header_size - self->offset;
+        }
+        else {
+            const size_t offset = self->offset - frame->header_size;
+            info->buffer = frame->pdu->pdu_data + offset;
+            info->buffer_size = frame->pdu->pdu_size - offset;
+        }
+    }
+}
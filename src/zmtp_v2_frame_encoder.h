@@ -2,6 +2,8 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.*/
 
+#include <sys/uio.h>
+
 #include "pdu.h"
 #include "iobuf.h"
 
@@ -11,8 +13,14 @@
 #define ZMTP_V2_FRAME_ENCODER_READY     0x01
 #define ZMTP_V2_FRAME_ENCODER_READ_OK   0x02
 
+//  Number of frames the encoder can hold
+#define ZMTP_V2_FRAME_ENCODER_MAX_FRAMES    32
+
 typedef struct zmtp_v2_frame_encoder zmtp_v2_frame_encoder_t;
 
+//  READY is set while the encoder accepts more frames, READ_OK while
+//  it holds frames not written yet. The buffer is the next contiguous
+//  span of output.
 struct zmtp_v2_frame_encoder_info {
     unsigned int flags;
     uint8_t *buffer;
@@ -32,10 +40,17 @@ int
     zmtp_v2_frame_encoder_read (zmtp_v2_frame_encoder_t *self,
         iobuf_t *iobuf, zmtp_v2_frame_encoder_info_t *info);
 
+//  Mark n bytes of output as written; n may span several frames
 int
     zmtp_v2_frame_encoder_advance (zmtp_v2_frame_encoder_t *self,
         size_t n, zmtp_v2_frame_encoder_info_t *info);
 
+//  Describe output of all queued frames, headers and bodies, in up to
+//  iovcnt entries. Returns number of entries filled.
+int
+    zmtp_v2_frame_encoder_iovec (zmtp_v2_frame_encoder_t *self,
+        struct iovec *iov, int iovcnt);
+
 void
     zmtp_v2_frame_encoder_destroy (zmtp_v2_frame_encoder_t **base_p);
 